@@ -0,0 +1,118 @@
+//
+//  GPMFAlign.c
+//  Alinhamento de streams colunares numa base de tempo comum
+//
+
+#include "GPMFAlign.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+// MARK: - SWEEP
+
+// Preenche as colunas de um canal. 'cursor' é o primeiro sample com tempo >= alvo;
+// como a base é crescente ele só anda para frente.
+static void align_channel(const double* target_times, int32_t target_count,
+                          const C_GPMFAlignChannel* channel, double* out) {
+    const size_t rows = (size_t)target_count;
+    const int32_t elements = channel->elements_per_sample;
+    const int32_t n = channel->sample_count;
+    const double* times = channel->timestamps;
+    const double tolerance = channel->tolerance;
+
+    int32_t cursor = 0;
+    for (size_t row = 0; row < rows; row++) {
+        const double t = target_times[row];
+        while (cursor < n && times[cursor] < t) cursor++;
+
+        // Vizinhos: cursor - 1 (antes) e cursor (em t ou depois). Empate fica com o anterior.
+        int32_t best = -1;
+        double best_diff = HUGE_VAL;
+        if (cursor > 0) {
+            best = cursor - 1;
+            best_diff = t - times[cursor - 1];
+        }
+        if (cursor < n && times[cursor] - t < best_diff) {
+            best = cursor;
+            best_diff = times[cursor] - t;
+        }
+
+        if (best < 0 || best_diff > tolerance) {
+            if (channel->mode == GPMF_ALIGN_HOLD && row > 0) {
+                for (int32_t j = 0; j < elements; j++) out[(size_t)j * rows + row] = out[(size_t)j * rows + row - 1];
+            } else {
+                for (int32_t j = 0; j < elements; j++) out[(size_t)j * rows + row] = NAN;
+            }
+            continue;
+        }
+
+        const double* values = channel->values;
+        const size_t stride = (size_t)n;
+
+        if (channel->mode == GPMF_ALIGN_LINEAR && cursor > 0 && cursor < n && times[cursor] > times[cursor - 1]) {
+            const double w = (t - times[cursor - 1]) / (times[cursor] - times[cursor - 1]);
+            for (int32_t j = 0; j < elements; j++) {
+                const double a = values[(size_t)j * stride + (size_t)(cursor - 1)];
+                const double b = values[(size_t)j * stride + (size_t)cursor];
+                out[(size_t)j * rows + row] = a + (b - a) * w;
+            }
+        } else {
+            for (int32_t j = 0; j < elements; j++) {
+                out[(size_t)j * rows + row] = values[(size_t)j * stride + (size_t)best];
+            }
+        }
+    }
+}
+
+// MARK: - API
+
+C_GPMFAlignedSet* gpmf_align_streams(const double* target_times, int32_t target_count,
+                                     const C_GPMFAlignChannel* channels, int32_t channel_count) {
+    if (target_count < 0 || channel_count < 0 || (target_count > 0 && !target_times)) return NULL;
+
+    C_GPMFAlignedSet* set = calloc(1, sizeof(C_GPMFAlignedSet));
+    if (!set) return NULL;
+    set->sample_count = target_count;
+
+    if (channel_count > 0) {
+        set->streams = calloc((size_t)channel_count, sizeof(C_GPMFAlignedStream));
+        if (!set->streams) {
+            free(set);
+            return NULL;
+        }
+    }
+    set->stream_count = channel_count;
+
+    for (int32_t i = 0; i < channel_count; i++) {
+        const C_GPMFAlignChannel* channel = &channels[i];
+        const int32_t elements = channel->elements_per_sample > 0 ? channel->elements_per_sample : 0;
+        set->streams[i].elements_per_sample = elements;
+
+        size_t total = (size_t)elements * (size_t)target_count;
+        if (total == 0) continue;
+
+        double* out = malloc(total * sizeof(double));
+        if (!out) {
+            free_aligned_set(set);
+            return NULL;
+        }
+        set->streams[i].values = out;
+
+        if (channel->sample_count <= 0 || !channel->timestamps || !channel->values) {
+            for (size_t k = 0; k < total; k++) out[k] = NAN;
+            continue;
+        }
+        align_channel(target_times, target_count, channel, out);
+    }
+
+    return set;
+}
+
+void free_aligned_set(C_GPMFAlignedSet* set) {
+    if (!set) return;
+    for (int32_t i = 0; i < set->stream_count; i++) {
+        free(set->streams[i].values);
+    }
+    free(set->streams);
+    free(set);
+}
@@ -0,0 +1,68 @@
+//
+//  GPMFAlign.h
+//  Alinhamento de streams colunares numa base de tempo comum
+//
+
+#ifndef GPMFAlign_h
+#define GPMFAlign_h
+
+#include <stdint.h>
+
+// MARK: - ESTRUTURAS DE DADOS
+
+/*
+ * C_GPMFAlignMode
+ * Como cada stream é lido nos tempos da base.
+ */
+typedef enum {
+    GPMF_ALIGN_NEAREST = 0,  // Sample mais próximo dentro da tolerância, senão vazio
+    GPMF_ALIGN_LINEAR  = 1,  // Interpola entre os vizinhos (se o mais próximo estiver na tolerância)
+    GPMF_ALIGN_HOLD    = 2   // Como NEAREST, mas repete o último valor quando não há sample
+} C_GPMFAlignMode;
+
+/*
+ * C_GPMFAlignChannel
+ * Stream de entrada no mesmo layout de C_GPMFColumnStream (tempos crescentes,
+ * coluna j em values + j * sample_count).
+ */
+typedef struct {
+    const double* timestamps;
+    const double* values;
+    int32_t sample_count;
+    int32_t elements_per_sample;
+    int32_t mode;              // C_GPMFAlignMode
+    double tolerance;          // Distância máxima (segundos) até o sample usado
+} C_GPMFAlignChannel;
+
+/*
+ * C_GPMFAlignedStream
+ * Stream reamostrado: elements_per_sample colunas de sample_count doubles
+ * (mesmo layout de entrada). NaN marca as posições sem sample.
+ */
+typedef struct {
+    double* values;
+    int32_t elements_per_sample;
+} C_GPMFAlignedStream;
+
+/*
+ * C_GPMFAlignedSet
+ * Um C_GPMFAlignedStream por canal, na ordem dos canais, todos com
+ * sample_count posições (os tempos da base).
+ */
+typedef struct {
+    C_GPMFAlignedStream* streams;
+    int32_t stream_count;
+    int32_t sample_count;
+} C_GPMFAlignedSet;
+
+// MARK: - FUNÇÕES EXPORTADAS
+
+// Reamostra cada canal nos tempos 'target_times' (crescentes). Cada canal é percorrido
+// numa única varredura com cursor, junto com a base: custo O(base + samples) por canal.
+// NULL se faltar memória. Liberar com free_aligned_set.
+C_GPMFAlignedSet* gpmf_align_streams(const double* target_times, int32_t target_count,
+                                     const C_GPMFAlignChannel* channels, int32_t channel_count);
+
+void free_aligned_set(C_GPMFAlignedSet* set);
+
+#endif /* GPMFAlign_h */
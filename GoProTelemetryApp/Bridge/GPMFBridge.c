@@ -4,6 +4,8 @@
 //
 
 #include "GPMFBridge.h"
+#include "GPMFCache.h"
+#include "GPMFTrace.h"
 #include "GPMF_parser.h"
 #include "GPMF_utils.h"
 #include "GPMF_mp4reader.h"
@@ -11,20 +13,45 @@
 #include <stdint.h>
 #include <string.h>
 #include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
 
 // MARK: - HELPERS
 
-int has_gpmf_stream(const char* file_path) {
-    if (!file_path) return 0;
+// Relógio monotônico em ns (perfil e trace opcionais da extração)
+static uint64_t profile_clock(void) {
+    return gpmf_trace_clock();
+}
+
+void gpmf_set_cache_directory(const char* directory) {
+    // Índice de payloads persistido: reaberturas do mesmo arquivo pulam a leitura do moov
+    SetMP4IndexCacheDirectory(directory);
+    // Colunas decodificadas: reaberturas pulam a decodificação inteira
+    gpmf_cache_set_directory(directory);
+}
 
-    size_t mp4Handle = OpenMP4Source((char*)file_path, MOV_GPMF_TRAK_TYPE, MOV_GPMF_TRAK_SUBTYPE, 0);
+void gpmf_set_trace_file(const char* path) {
+    gpmf_trace_set_file(path);
+}
+
+// Abre a trilha GPMF mapeada em memória (GetPayload devolve ponteiros direto no mapa),
+// com fallback para GPMF gravado em udta
+static size_t open_gpmf_source(const char* file_path) {
+    size_t mp4Handle = OpenMP4Source((char*)file_path, MOV_GPMF_TRAK_TYPE, MOV_GPMF_TRAK_SUBTYPE, MP4_FLAG_MEMORY_MAP | MP4_FLAG_INDEX_CACHE);
     if (!mp4Handle) {
-        mp4Handle = OpenMP4SourceUDTA((char*)file_path, 0);
+        mp4Handle = OpenMP4SourceUDTA((char*)file_path, MP4_FLAG_MEMORY_MAP);
     }
-    if (!mp4Handle) return 0;
+    return mp4Handle;
+}
 
-    uint32_t numPayloads = GetNumberPayloads(mp4Handle);
-    CloseSource(mp4Handle);
+int has_gpmf_stream(const char* file_path) {
+    C_GPMFSession* session = gpmf_session_open(file_path);
+    if (!session) return 0;
+
+    uint32_t numPayloads = gpmf_session_payload_count(session);
+    gpmf_session_close(session);
 
     return numPayloads > 0 ? 1 : 0;
 }
@@ -32,206 +59,1604 @@ int has_gpmf_stream(const char* file_path) {
 // MARK: - METADATA EXTRACTION (NOVO)
 
 char* get_device_name(const char* file_path) {
-    if (!file_path) return NULL;
+    C_GPMFSession* session = gpmf_session_open(file_path);
+    if (!session) return NULL;
 
-    size_t mp4Handle = OpenMP4Source((char*)file_path, MOV_GPMF_TRAK_TYPE, MOV_GPMF_TRAK_SUBTYPE, 0);
-    if (!mp4Handle) return NULL;
-
-    uint32_t numPayloads = GetNumberPayloads(mp4Handle);
     char* deviceName = NULL;
+    const char* name = gpmf_session_device_name(session);
+    if (name) {
+        size_t size = strlen(name);
+        deviceName = (char*)malloc(size + 1);
+        if (deviceName) memcpy(deviceName, name, size + 1);
+    }
+
+    gpmf_session_close(session);
+    return deviceName;
+}
 
-    // Procura o nome apenas nos primeiros payloads (geralmente está no início)
-    for (uint32_t i = 0; i < numPayloads && i < 5; i++) {
-        uint32_t payloadSize = GetPayloadSize(mp4Handle, i);
-        if (payloadSize == 0) continue;
+// MARK: - CORE PARSER (EXTRAÇÃO COMPLETA)
 
-        size_t payloadres = GetPayloadResource(mp4Handle, 0, payloadSize);
-        uint32_t* payload = GetPayload(mp4Handle, payloadres, i);
-        if (!payload) continue;
+#define MAX_STREAM_TYPES 60 // Aumentado para suportar novos sensores
+#define MAX_DECODE_THREADS 64
+#define MAX_FILTER_KEYS 32
+#define ACC_HASH_SLOTS 128 // Potência de 2, acima do dobro de MAX_STREAM_TYPES
+#define ARENA_BLOCK_SIZE (1u << 20) // Blocos de 1 MB; pedidos maiores ganham bloco próprio
+#define CHUNK_BYTES (64u * 1024u)   // Tamanho alvo de um chunk de colunas
 
-        GPMF_stream gs;
-        if (GPMF_Init(&gs, payload, payloadSize) == GPMF_OK) {
-            // Procura por DEVC -> DVNM
-            if (GPMF_FindNext(&gs, GPMF_KEY_DEVICE, GPMF_RECURSE_LEVELS) == GPMF_OK) {
-                GPMF_stream dev_stream;
-                GPMF_CopyState(&gs, &dev_stream);
-                
-                if (GPMF_FindNext(&dev_stream, GPMF_KEY_DEVICE_NAME, GPMF_RECURSE_LEVELS) == GPMF_OK) {
-                    char* data = (char*)GPMF_RawData(&dev_stream);
-                    uint32_t size = GPMF_RawDataSize(&dev_stream);
-                    
-                    if (data && size > 0) {
-                        deviceName = (char*)malloc(size + 1);
-                        memcpy(deviceName, data, size);
-                        deviceName[size] = '\0'; // Null-terminate
-                        
-                        FreePayloadResource(mp4Handle, payloadres);
-                        break; // Achou, pode sair
-                    }
-                }
+// MARK: - ARENA
+
+// Bloco da arena: cabeçalho + área de alocação (alinhada em 16 bytes)
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t used;
+    size_t size;
+    size_t reserved;       // Mantém o cabeçalho em 32 bytes
+} ArenaBlock;
+
+// Arena de uma extração: só cresce, e tudo é liberado de uma vez no final.
+// Não é thread-safe: cada worker tem a sua.
+typedef struct {
+    ArenaBlock* head;      // Bloco atual (os demais já estão cheios ou são dedicados)
+} ParseArena;
+
+static void* arena_alloc(ParseArena* arena, size_t size) {
+    size = (size + 15) & ~(size_t)15;
+
+    ArenaBlock* block = arena->head;
+    if (block && block->size - block->used >= size) {
+        void* ptr = (char*)(block + 1) + block->used;
+        block->used += size;
+        return ptr;
+    }
+
+    size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+    ArenaBlock* fresh = malloc(sizeof(ArenaBlock) + block_size);
+    if (!fresh) return NULL;
+    fresh->used = size;
+    fresh->size = block_size;
+
+    if (block && block_size > ARENA_BLOCK_SIZE) {
+        // Bloco dedicado entra atrás do atual, que ainda tem espaço livre
+        fresh->next = block->next;
+        block->next = fresh;
+    } else {
+        fresh->next = block;
+        arena->head = fresh;
+    }
+    return fresh + 1;
+}
+
+// Transfere os blocos de 'src' para 'dst' (o bloco atual de 'dst' continua o mesmo)
+static void arena_absorb(ParseArena* dst, ParseArena* src) {
+    if (!src->head) return;
+    if (!dst->head) {
+        dst->head = src->head;
+    } else {
+        ArenaBlock* last = src->head;
+        while (last->next) last = last->next;
+        last->next = dst->head->next;
+        dst->head->next = src->head;
+    }
+    src->head = NULL;
+}
+
+static uint64_t arena_block_count(const ParseArena* arena) {
+    uint64_t count = 0;
+    for (const ArenaBlock* block = arena->head; block; block = block->next) count++;
+    return count;
+}
+
+static void arena_free(ParseArena* arena) {
+    ArenaBlock* block = arena->head;
+    while (block) {
+        ArenaBlock* next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = NULL;
+}
+
+// Âncora de tempo de um bloco de samples (um por stream por payload)
+typedef struct {
+    int32_t first_row;     // Índice do primeiro sample do bloco na coluna
+    int32_t count;
+    double payload_in;     // Tempo MP4 do payload (já inclui o offset da edit list)
+    double payload_out;
+    uint64_t stmp;         // STMP do bloco (relógio da câmera), se presente
+    uint32_t tsmp;         // TSMP do bloco (total acumulado de samples), se presente
+    uint8_t has_stmp;
+    uint8_t has_tsmp;
+    uint8_t has_payload_time;
+    uint16_t chapter;      // Capítulo de origem (0 num arquivo único)
+} TimeAnchor;
+
+// Pedaço de tamanho fixo de um acumulador: 'capacity' linhas de cada coluna,
+// coluna j em values + j * capacity. Vem da arena e nunca é realocado.
+typedef struct ColumnChunk {
+    struct ColumnChunk* next;
+    int32_t rows;
+    int32_t capacity;
+    double values[];
+} ColumnChunk;
+
+// Acumulador colunar: lista de chunks com uma coluna por elemento (os tempos são
+// gerados na finalização). Crescer é só pegar outro chunk da arena, sem copiar.
+// Identificado por (DVID, FourCC): o mesmo sensor em dispositivos diferentes não se mistura.
+typedef struct {
+    char type[5];
+    uint32_t fourcc;
+    uint32_t device_id;
+    ColumnChunk* head;
+    ColumnChunk* tail;
+    int32_t sample_count;
+    int32_t elements_per_sample;
+    TimeAnchor* anchors;
+    int32_t anchor_count;
+    int32_t anchor_capacity;
+} ColumnAccumulator;
+
+// Acumuladores + índice hash (endereçamento aberto) por (DVID, FourCC).
+// Os chunks de todos os acumuladores moram na arena da tabela.
+typedef struct {
+    ColumnAccumulator accs[MAX_STREAM_TYPES];
+    int count;
+    int16_t slots[ACC_HASH_SLOTS]; // Índice + 1 em accs (0 = vazio)
+    ParseArena arena;
+} AccumulatorTable;
+
+// Allow-list de FourCC: chave comparada sob máscara (nomes curtos viram prefixo)
+typedef struct {
+    uint32_t keys[MAX_FILTER_KEYS];
+    uint32_t masks[MAX_FILTER_KEYS];
+    int count;
+} StreamFilter;
+
+// Capítulo de uma sessão: um MP4 e sua faixa na tabela de payloads concatenada.
+// Um arquivo único é uma sessão de um capítulo.
+typedef struct {
+    size_t mp4Handle;
+    uint32_t first_payload; // Índice global do primeiro payload do capítulo
+    uint32_t payload_count;
+    double time_offset;     // Duração somada dos capítulos anteriores (s)
+    uint16_t index;
+} SessionChapter;
+
+// Estado de um worker: faixa contígua de payloads e acumuladores próprios
+typedef struct {
+    const SessionChapter* chapters;
+    int32_t chapter_count;
+    pthread_mutex_t* read_locks; // Um por capítulo (FILE* próprio)
+    const StreamFilter* filter;
+    uint32_t first_payload;
+    uint32_t end_payload;
+    AccumulatorTable table;
+    char device_name[32];  // Primeiro DVNM visto na faixa
+    int profiling;         // Coleta contadores e tempos (C_GPMFParseOptions.profile)
+    GPMFTraceBuffer* trace; // Spans desta faixa (NULL = sem trace)
+    GPMF_counters counters;
+    uint64_t index_ns;
+    uint64_t accumulate_ns;
+} DecodeWorker;
+
+// Os chunks ficam na arena da tabela: aqui só saem as âncoras
+static void free_accumulator(ColumnAccumulator* acc) {
+    free(acc->anchors);
+    memset(acc, 0, sizeof(ColumnAccumulator));
+}
+
+// Chunk com espaço livre no fim da lista (pega um novo da arena quando o último enche)
+static ColumnChunk* writable_chunk(ColumnAccumulator* acc, ParseArena* arena) {
+    if (acc->tail && acc->tail->rows < acc->tail->capacity) return acc->tail;
+
+    size_t row_bytes = (size_t)acc->elements_per_sample * sizeof(double);
+    int32_t capacity = (int32_t)(CHUNK_BYTES / row_bytes);
+    if (capacity < 64) capacity = 64;
+
+    ColumnChunk* chunk = arena_alloc(arena, sizeof(ColumnChunk) + (size_t)capacity * row_bytes);
+    if (!chunk) return NULL;
+    chunk->next = NULL;
+    chunk->rows = 0;
+    chunk->capacity = capacity;
+
+    if (acc->tail) acc->tail->next = chunk;
+    else acc->head = chunk;
+    acc->tail = chunk;
+    return chunk;
+}
+
+// Copia as linhas [first, first + count) da coluna j para 'out'
+static void copy_accumulator_column(const ColumnAccumulator* acc, int32_t j, size_t first, size_t count, double* out) {
+    size_t chunk_first = 0;
+    for (const ColumnChunk* chunk = acc->head; chunk && count > 0; chunk = chunk->next) {
+        size_t rows = (size_t)chunk->rows;
+        if (first < chunk_first + rows) {
+            size_t offset = first - chunk_first;
+            size_t n = rows - offset < count ? rows - offset : count;
+            memcpy(out, chunk->values + (size_t)j * (size_t)chunk->capacity + offset, n * sizeof(double));
+            out += n;
+            first += n;
+            count -= n;
+        }
+        chunk_first += rows;
+    }
+}
+
+static TimeAnchor* add_anchor(ColumnAccumulator* acc) {
+    if (acc->anchor_count == acc->anchor_capacity) {
+        int32_t new_capacity = acc->anchor_capacity ? acc->anchor_capacity * 2 : 64;
+        TimeAnchor* grown = realloc(acc->anchors, (size_t)new_capacity * sizeof(TimeAnchor));
+        if (!grown) return NULL;
+        acc->anchors = grown;
+        acc->anchor_capacity = new_capacity;
+    }
+    TimeAnchor* anchor = &acc->anchors[acc->anchor_count++];
+    memset(anchor, 0, sizeof(TimeAnchor));
+    return anchor;
+}
+
+static uint32_t accumulator_hash(uint32_t device_id, uint32_t fourcc) {
+    uint32_t h = fourcc * 0x9E3779B1u ^ device_id * 0x85EBCA77u;
+    return (h ^ (h >> 15)) & (ACC_HASH_SLOTS - 1);
+}
+
+static ColumnAccumulator* find_or_add_accumulator(AccumulatorTable* table, uint32_t device_id, uint32_t fourcc, int32_t elements) {
+    uint32_t slot = accumulator_hash(device_id, fourcc);
+
+    // Sondagem linear: a tabela nunca passa da metade da ocupação
+    while (table->slots[slot] != 0) {
+        ColumnAccumulator* acc = &table->accs[table->slots[slot] - 1];
+        if (acc->fourcc == fourcc && acc->device_id == device_id) return acc;
+        slot = (slot + 1) & (ACC_HASH_SLOTS - 1);
+    }
+    if (table->count >= MAX_STREAM_TYPES) return NULL;
+
+    ColumnAccumulator* acc = &table->accs[table->count++];
+    table->slots[slot] = (int16_t)table->count;
+
+    memcpy(acc->type, &fourcc, 4);
+    acc->type[4] = '\0';
+    acc->fourcc = fourcc;
+    acc->device_id = device_id;
+    acc->elements_per_sample = elements;
+    return acc;
+}
+
+// Lê STMP e TSMP do STRM atual (ficam antes dos dados, no mesmo nível)
+static void read_block_clock(GPMF_stream* data_stream, TimeAnchor* anchor) {
+    GPMF_stream find_stream;
+
+    GPMF_CopyState(data_stream, &find_stream);
+    if (GPMF_FindPrev(&find_stream, GPMF_KEY_TIME_STAMP, GPMF_CURRENT_LEVEL) == GPMF_OK &&
+        GPMF_RawDataSize(&find_stream) >= 8) {
+        uint64_t raw;
+        memcpy(&raw, GPMF_RawData(&find_stream), sizeof(raw)); // STMP só é alinhado em 4 bytes
+        anchor->stmp = BYTESWAP64(raw);
+        anchor->has_stmp = 1;
+    }
+
+    GPMF_CopyState(data_stream, &find_stream);
+    if (GPMF_FindPrev(&find_stream, GPMF_KEY_TOTAL_SAMPLES, GPMF_CURRENT_LEVEL) == GPMF_OK &&
+        GPMF_RawDataSize(&find_stream) >= 4) {
+        anchor->tsmp = BYTESWAP32(*(uint32_t*)GPMF_RawData(&find_stream));
+        anchor->has_tsmp = 1;
+    }
+}
+
+// Estado de decodificação reaproveitado entre payloads (um por thread)
+typedef struct {
+    double* buffer;        // Buffer de conversão reaproveitado entre streams e payloads
+    uint32_t capacity;
+    GPMF_calibration_cache calibration; // SCAL/MTRX/ORIN/ORIO/TYPE já resolvidos (iguais em todo payload)
+    GPMF_index index;      // Onde começam os samples de cada STRM do payload atual
+    GPMF_scratch decompress; // Destino da descompressão '#', reaproveitado entre STRMs e payloads
+    GPMF_counters* counters; // Perfil: contadores do parser (NULL = sem medição)
+    uint64_t index_ns;     // Perfil: tempo em GPMF_BuildIndex
+    uint64_t sink_ns;      // Perfil: tempo no consumidor dos blocos
+    GPMFTraceBuffer* trace; // Spans da thread (NULL = sem trace)
+} DecodeScratch;
+
+// Bloco decodificado de um STRM: samples intercalados (layout GPMF) + âncora de tempo
+typedef struct {
+    char type[5];
+    uint32_t fourcc;
+    uint32_t device_id;    // DVID do DEVC atual
+    uint32_t samples;
+    uint32_t elements;
+    const double* data;
+    const char* device_name; // DVNM do DEVC atual ("" se ausente)
+    TimeAnchor anchor;     // first_row é definido por quem consome o bloco
+} DecodedBlock;
+
+// Consumidor de blocos. Retorna 0 para interromper a decodificação.
+typedef int (*BlockSink)(void* context, const DecodedBlock* block);
+
+static void free_scratch(DecodeScratch* scratch) {
+    free(scratch->buffer);
+    GPMF_FreeScratch(&scratch->decompress);
+    memset(scratch, 0, sizeof(DecodeScratch));
+}
+
+// Monta o filtro a partir de "GPS5,GPS9" (separadores: vírgula ou espaço).
+// Retorna 0 quando a lista é vazia, ou seja, sem filtro.
+static int parse_stream_filter(const char* list, StreamFilter* filter) {
+    memset(filter, 0, sizeof(StreamFilter));
+    if (!list) return 0;
+
+    const char* p = list;
+    while (*p && filter->count < MAX_FILTER_KEYS) {
+        while (*p == ',' || *p == ' ') p++;
+
+        uint32_t key = 0, mask = 0;
+        int len = 0;
+        while (*p && *p != ',' && *p != ' ') {
+            if (len < 4) {
+                key |= (uint32_t)(uint8_t)*p << (8 * len);
+                mask |= 0xFFu << (8 * len);
             }
+            len++;
+            p++;
+        }
+
+        if (len > 0) {
+            filter->keys[filter->count] = key;
+            filter->masks[filter->count] = mask;
+            filter->count++;
         }
-        FreePayloadResource(mp4Handle, payloadres);
     }
+    return filter->count > 0;
+}
 
-    CloseSource(mp4Handle);
-    return deviceName;
+static int stream_allowed(const StreamFilter* filter, uint32_t fourcc_key) {
+    if (!filter) return 1;
+    for (int i = 0; i < filter->count; i++) {
+        if ((fourcc_key & filter->masks[i]) == filter->keys[i]) return 1;
+    }
+    return 0;
 }
 
-// MARK: - CORE PARSER (EXTRAÇÃO COMPLETA)
+// Próximo STRM do payload, já nos samples. Com o índice completo vem dele, em ordem;
+// com índice incompleto (STRMs demais ou aninhados além de GPMF_INDEX_LEVELS) a
+// caminhada por GPMF_FindNext em 'walker' garante que nenhum stream some.
+// Retorna 0 no fim do payload.
+static int next_payload_stream(GPMF_stream* walker, GPMF_index* index, int indexed, uint32_t* next,
+                               GPMF_stream* data_stream) {
+    if (indexed) {
+        if (*next >= index->count) return 0;
+        GPMF_CopyState(walker, data_stream);
+        return GPMF_SeekToIndexed(data_stream, index, (*next)++) == GPMF_OK;
+    }
 
-C_GPMFStream* parse_gpmf_from_file(const char* file_path) {
-    if (!file_path) return NULL;
+    while (GPMF_FindNext(walker, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS) == GPMF_OK) {
+        GPMF_CopyState(walker, data_stream);
+        if (GPMF_SeekToSamples(data_stream) == GPMF_OK) return 1;
+    }
+    return 0;
+}
 
-    size_t mp4Handle = OpenMP4Source((char*)file_path, MOV_GPMF_TRAK_TYPE, MOV_GPMF_TRAK_SUBTYPE, 0);
-    if (!mp4Handle) {
-        mp4Handle = OpenMP4SourceUDTA((char*)file_path, 0);
+// Decodifica todos os STRM de um payload e entrega cada bloco ao sink.
+// Streams fora do filtro (se houver) são pulados antes de qualquer conversão.
+// Retorna 0 se o sink pediu para parar.
+static int decode_payload(const SessionChapter* chapter, uint32_t local_index, uint32_t* payload, uint32_t payloadSize,
+                          const StreamFilter* filter, DecodeScratch* scratch, BlockSink sink, void* context) {
+    GPMF_stream gpmf_stream;
+    if (GPMF_Init(&gpmf_stream, payload, payloadSize) != GPMF_OK) return 1;
+
+    GPMF_ResetState(&gpmf_stream);
+    GPMF_SetCalibrationCache(&gpmf_stream, &scratch->calibration); // Herdado pelas cópias de cada STRM
+    GPMF_SetCounters(&gpmf_stream, scratch->counters);
+    GPMF_SetScratch(&gpmf_stream, &scratch->decompress);
+
+    // Tempo MP4 do payload (comum a todos os blocos), na timeline da sessão
+    uint32_t payload_index = chapter->first_payload + local_index;
+    double payload_in = 0.0, payload_out = 0.0;
+    int has_payload_time = GetPayloadTime(chapter->mp4Handle, local_index, &payload_in, &payload_out) == MP4_ERROR_OK;
+    payload_in += chapter->time_offset;
+    payload_out += chapter->time_offset;
+
+    // Uma passada indexa todos os STRM; o filtro é aplicado sobre o índice
+    int timed = scratch->counters || scratch->trace;
+    uint64_t index_start = timed ? profile_clock() : 0;
+    int indexed = GPMF_BuildIndex(&gpmf_stream, &scratch->index) == GPMF_OK;
+    if (timed) {
+        uint64_t index_end = profile_clock();
+        scratch->index_ns += index_end - index_start;
+        gpmf_trace_span(scratch->trace, "index", index_start, index_end, (int32_t)payload_index, 0, payloadSize, 0);
     }
-    if (!mp4Handle) return NULL;
 
-    uint32_t numPayloads = GetNumberPayloads(mp4Handle);
-    if (numPayloads == 0) {
-        CloseSource(mp4Handle);
-        return NULL;
+    // Loop de Streams
+    GPMF_stream walker, data_stream;
+    GPMF_CopyState(&gpmf_stream, &walker);
+    uint32_t next = 0;
+    while (next_payload_stream(&walker, &scratch->index, indexed, &next, &data_stream)) {
+        uint32_t fourcc_key = GPMF_Key(&data_stream);
+        if (fourcc_key == 0 || !stream_allowed(filter, fourcc_key)) continue;
+
+        DecodedBlock block;
+        memset(&block, 0, sizeof(block));
+
+        // Identificação do Tipo
+        block.type[0] = (char)((fourcc_key >> 0) & 0xFF);
+        block.type[1] = (char)((fourcc_key >> 8) & 0xFF);
+        block.type[2] = (char)((fourcc_key >> 16) & 0xFF);
+        block.type[3] = (char)((fourcc_key >> 24) & 0xFF);
+        block.fourcc = fourcc_key;
+        block.device_id = data_stream.device_id; // DVID do DEVC que contém o STRM
+
+        block.samples = GPMF_PayloadSampleCount(&data_stream);
+        block.elements = GPMF_ElementsInStruct(&data_stream);
+        if (block.samples == 0 || block.elements == 0 || block.elements > 64) continue;
+
+        // Extração
+        uint32_t buffersize = block.samples * block.elements * sizeof(double);
+        if (buffersize == 0 || buffersize >= 20000000) continue;
+
+        if (buffersize > scratch->capacity) {
+            double* grown = realloc(scratch->buffer, buffersize + 256);
+            if (!grown) continue;
+            scratch->buffer = grown;
+            scratch->capacity = buffersize;
+        }
+
+        // GPMF_ScaledData converte tudo para Double (incluindo ISO, Shutter, etc)
+        // Streams comprimidos são descomprimidos no scratch da thread (herdado pela cópia)
+        uint32_t raw_size = scratch->trace ? GPMF_RawDataSize(&data_stream) : 0; // Tamanho no payload (comprimido, se '#')
+        uint64_t scale_start = scratch->trace ? profile_clock() : 0;
+        GPMF_ERR scaled = GPMF_ScaledData(&data_stream, scratch->buffer, buffersize, 0, block.samples, GPMF_TYPE_DOUBLE);
+        if (scratch->trace) {
+            gpmf_trace_span(scratch->trace, "scale", scale_start, profile_clock(), (int32_t)payload_index, fourcc_key, raw_size, block.samples);
+        }
+        if (scaled != GPMF_OK) continue;
+
+        // Tempo do bloco: payload MP4 + STMP/TSMP do próprio STRM
+        block.data = scratch->buffer;
+        block.device_name = data_stream.device_name; // DVNM do DEVC (válido durante o sink)
+        block.anchor.count = (int32_t)block.samples;
+        block.anchor.payload_in = payload_in;
+        block.anchor.payload_out = payload_out;
+        block.anchor.has_payload_time = (uint8_t)has_payload_time;
+        block.anchor.chapter = chapter->index;
+        read_block_clock(&data_stream, &block.anchor);
+
+        if (timed) {
+            uint64_t sink_start = profile_clock();
+            int keep_going = sink(context, &block);
+            uint64_t sink_end = profile_clock();
+            scratch->sink_ns += sink_end - sink_start;
+            gpmf_trace_span(scratch->trace, "accumulate", sink_start, sink_end, (int32_t)payload_index, fourcc_key, 0, block.samples);
+            if (!keep_going) return 0;
+        } else if (!sink(context, &block)) {
+            return 0;
+        }
     }
 
-    // Estrutura temporária
-    typedef struct {
-        char type[5];
-        C_GPMFSample* samples;
-        int32_t sample_count;
-        int32_t capacity;
-        int32_t elements_per_sample;
-        double sample_rate;
-    } TempStream;
+    return 1;
+}
+
+// Sink da extração completa: transpõe o bloco para as colunas do acumulador
+static int accumulate_block(void* context, const DecodedBlock* block) {
+    DecodeWorker* worker = (DecodeWorker*)context;
+
+    if (worker->device_name[0] == '\0' && block->device_name && block->device_name[0] != '\0') {
+        strncpy(worker->device_name, block->device_name, sizeof(worker->device_name) - 1);
+    }
+
+    // Busca ou Criação do Acumulador
+    ColumnAccumulator* acc = find_or_add_accumulator(&worker->table, block->device_id, block->fourcc, (int32_t)block->elements);
+
+    // Blocos com layout diferente do primeiro não cabem nas colunas
+    if (!acc || acc->elements_per_sample != (int32_t)block->elements) return 1;
+
+    TimeAnchor* anchor = add_anchor(acc);
+    if (!anchor) return 1;
+    *anchor = block->anchor;
+    anchor->first_row = acc->sample_count;
+
+    // Transposição: sample-major (GPMF) -> coluna por elemento, chunk a chunk
+    uint32_t i = 0;
+    while (i < block->samples) {
+        ColumnChunk* chunk = writable_chunk(acc, &worker->table.arena);
+        if (!chunk) break;
+
+        uint32_t n = (uint32_t)(chunk->capacity - chunk->rows);
+        if (n > block->samples - i) n = block->samples - i;
 
-    #define MAX_STREAM_TYPES 60 // Aumentado para suportar novos sensores
-    TempStream temp_streams[MAX_STREAM_TYPES];
-    int temp_stream_count = 0;
-    memset(temp_streams, 0, sizeof(temp_streams));
+        for (uint32_t j = 0; j < block->elements; j++) {
+            double* col = chunk->values + (size_t)j * (size_t)chunk->capacity + (size_t)chunk->rows;
+            const double* src = block->data + (size_t)i * block->elements + j;
+            for (uint32_t k = 0; k < n; k++) col[k] = src[(size_t)k * block->elements];
+        }
+        chunk->rows += (int32_t)n;
+        i += n;
+    }
+    acc->sample_count += (int32_t)i;
+    anchor->count = (int32_t)i;
+    return 1;
+}
 
+// Decodifica a faixa [first_payload, end_payload) nos acumuladores do worker.
+// Cada worker tem seu próprio GPMF_stream, buffer de payload, índice e cache de calibração.
+static void* decode_payload_range(void* arg) {
+    DecodeWorker* worker = (DecodeWorker*)arg;
+    const SessionChapter* chapter = worker->chapters;
     size_t payloadres = 0;
-    
+
+    DecodeScratch scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    if (worker->profiling) scratch.counters = &worker->counters;
+    scratch.trace = worker->trace;
+
     // Loop de Payloads
-    for (uint32_t payload_index = 0; payload_index < numPayloads; payload_index++) {
-        uint32_t payloadSize = GetPayloadSize(mp4Handle, payload_index);
+    for (uint32_t payload_index = worker->first_payload; payload_index < worker->end_payload; payload_index++) {
+        // A faixa pode atravessar capítulos: o buffer de payload pertence ao handle do capítulo
+        while (payload_index >= chapter->first_payload + chapter->payload_count &&
+               chapter + 1 < worker->chapters + worker->chapter_count) {
+            if (payloadres) FreePayloadResource(chapter->mp4Handle, payloadres);
+            payloadres = 0;
+            chapter++;
+        }
+        size_t mp4Handle = chapter->mp4Handle;
+        uint32_t local_index = payload_index - chapter->first_payload;
+
+        uint32_t payloadSize = GetPayloadSize(mp4Handle, local_index);
         if (payloadSize == 0 || payloadSize > 10000000) continue;
 
+        // A leitura compartilha o FILE* quando o mapeamento não está disponível.
+        // O span de leitura começa depois do lock: espera pelo lock aparece como intervalo vazio.
+        pthread_mutex_t* read_lock = &worker->read_locks[chapter->index];
+        pthread_mutex_lock(read_lock);
+        uint64_t read_start = worker->trace ? profile_clock() : 0;
         payloadres = GetPayloadResource(mp4Handle, payloadres, payloadSize);
-        uint32_t* payload = GetPayload(mp4Handle, payloadres, payload_index);
+        uint32_t* payload = GetPayload(mp4Handle, payloadres, local_index);
+        uint64_t read_end = worker->trace ? profile_clock() : 0;
+        pthread_mutex_unlock(read_lock);
+        gpmf_trace_span(worker->trace, "read", read_start, read_end, (int32_t)payload_index, 0, payloadSize, 0);
         if (!payload) continue;
 
-        GPMF_stream gpmf_stream;
-        if (GPMF_Init(&gpmf_stream, payload, payloadSize) != GPMF_OK) continue;
+        decode_payload(chapter, local_index, payload, payloadSize, worker->filter, &scratch, accumulate_block, worker);
+        if (worker->trace) {
+            gpmf_trace_span(worker->trace, "decode", read_end, profile_clock(), (int32_t)payload_index, 0, payloadSize, 0);
+        }
+    }
 
-        GPMF_ResetState(&gpmf_stream);
-        
-        // Loop de Streams
-        while (GPMF_FindNext(&gpmf_stream, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS) == GPMF_OK) {
-            
-            GPMF_stream data_stream;
-            GPMF_CopyState(&gpmf_stream, &data_stream);
+    worker->index_ns = scratch.index_ns;
+    worker->accumulate_ns = scratch.sink_ns;
+    free_scratch(&scratch);
+    if (payloadres) FreePayloadResource(chapter->mp4Handle, payloadres);
 
-            if (GPMF_SeekToSamples(&data_stream) != GPMF_OK) continue;
+    return NULL;
+}
+
+// Anexa as colunas de 'src' ao final de 'dst' (mesma ordem de payloads).
+// Os chunks só mudam de lista: a arena do worker é absorvida pela tabela de destino.
+static void append_accumulator(ColumnAccumulator* dst, ColumnAccumulator* src) {
+    if (dst->elements_per_sample != src->elements_per_sample || src->sample_count == 0) return;
+
+    // Âncoras passam a apontar para as linhas já deslocadas no destino
+    for (int32_t a = 0; a < src->anchor_count; a++) {
+        TimeAnchor* anchor = add_anchor(dst);
+        if (!anchor) return;
+        *anchor = src->anchors[a];
+        anchor->first_row += dst->sample_count;
+    }
+
+    if (dst->tail) dst->tail->next = src->head;
+    else dst->head = src->head;
+    dst->tail = src->tail;
+    dst->sample_count += src->sample_count;
+
+    src->head = src->tail = NULL;
+    src->sample_count = 0;
+}
+
+static int resolve_thread_count(const C_GPMFParseOptions* options, uint32_t numPayloads) {
+    long threads = options ? options->thread_count : 0;
+    if (threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN); // 0 = automático
+    if (threads < 1) threads = 1;
+    if (threads > MAX_DECODE_THREADS) threads = MAX_DECODE_THREADS;
+    if ((uint32_t)threads > numPayloads) threads = (long)numPayloads;
+    return (int)threads;
+}
+
+// Decodifica os payloads [first_payload, end_payload) nos acumuladores colunares.
+// 'device_name' (32 bytes) recebe o primeiro DVNM encontrado, se houver.
+// Retorna a quantidade de acumuladores usados (0 se a faixa não tem GPMF).
+static int extract_columns(const SessionChapter* chapters, int32_t chapter_count, uint32_t first_payload, uint32_t end_payload,
+                           const C_GPMFParseOptions* options, GPMFTrace* trace,
+                           AccumulatorTable* table, double* edit_offset, char* device_name) {
+    const SessionChapter* last_chapter = &chapters[chapter_count - 1];
+    uint32_t total_payloads = last_chapter->first_payload + last_chapter->payload_count;
+    if (end_payload > total_payloads) end_payload = total_payloads;
+    if (first_payload >= end_payload) return 0;
+    uint32_t numPayloads = end_payload - first_payload;
+
+    int thread_count = resolve_thread_count(options, numPayloads);
+    DecodeWorker* workers = calloc((size_t)thread_count, sizeof(DecodeWorker));
+    if (!workers) return 0;
+
+    StreamFilter filter;
+    int has_filter = parse_stream_filter(options ? options->fourcc_filter : NULL, &filter);
+
+    pthread_mutex_t* read_locks = malloc((size_t)chapter_count * sizeof(pthread_mutex_t));
+    if (!read_locks) {
+        free(workers);
+        return 0;
+    }
+    for (int32_t c = 0; c < chapter_count; c++) pthread_mutex_init(&read_locks[c], NULL);
+
+    // Divide os payloads em faixas contíguas (uma por worker)
+    C_GPMFProfile* profile = options ? options->profile : NULL;
+    if (profile) profile->thread_count = thread_count;
+    if (trace) trace->thread_count = thread_count;
+
+    for (int w = 0; w < thread_count; w++) {
+        workers[w].read_locks = read_locks;
+        workers[w].profiling = profile != NULL;
+        workers[w].trace = trace ? &trace->threads[w] : NULL; // MAX_DECODE_THREADS == GPMF_TRACE_MAX_THREADS
+        workers[w].filter = has_filter ? &filter : NULL;
+        workers[w].first_payload = first_payload + (uint32_t)((uint64_t)numPayloads * (uint64_t)w / (uint64_t)thread_count);
+        workers[w].end_payload = first_payload + (uint32_t)((uint64_t)numPayloads * (uint64_t)(w + 1) / (uint64_t)thread_count);
+
+        // Capítulo do primeiro payload da faixa (o worker avança pelos seguintes)
+        int32_t c = 0;
+        while (c + 1 < chapter_count && workers[w].first_payload >= chapters[c + 1].first_payload) c++;
+        workers[w].chapters = &chapters[c];
+        workers[w].chapter_count = chapter_count - c;
+    }
+
+    if (thread_count == 1) {
+        decode_payload_range(&workers[0]);
+    } else {
+        pthread_t threads[MAX_DECODE_THREADS];
+        int started[MAX_DECODE_THREADS] = { 0 };
+
+        for (int w = 1; w < thread_count; w++) {
+            started[w] = pthread_create(&threads[w], NULL, decode_payload_range, &workers[w]) == 0;
+        }
+        decode_payload_range(&workers[0]); // A thread atual processa a primeira faixa
+
+        for (int w = 1; w < thread_count; w++) {
+            if (started[w]) pthread_join(threads[w], NULL);
+            else decode_payload_range(&workers[w]); // Sem thread disponível: processa aqui mesmo
+        }
+    }
+
+    for (int32_t c = 0; c < chapter_count; c++) pthread_mutex_destroy(&read_locks[c]);
+    free(read_locks);
+
+    if (GetEditListOffset(chapters[0].mp4Handle, edit_offset) != MP4_ERROR_OK) *edit_offset = 0.0;
 
-            uint32_t fourcc_key = GPMF_Key(&data_stream);
-            if (fourcc_key == 0) continue;
-
-            // Identificação do Tipo
-            char stream_type[5];
-            stream_type[0] = (char)((fourcc_key >> 0) & 0xFF);
-            stream_type[1] = (char)((fourcc_key >> 8) & 0xFF);
-            stream_type[2] = (char)((fourcc_key >> 16) & 0xFF);
-            stream_type[3] = (char)((fourcc_key >> 24) & 0xFF);
-            stream_type[4] = '\0';
-
-            // Busca ou Criação do Acumulador
-            TempStream* ts = NULL;
-            for (int i = 0; i < temp_stream_count; i++) {
-                if (strncmp(temp_streams[i].type, stream_type, 4) == 0) {
-                    ts = &temp_streams[i];
-                    break;
+    // Junta os resultados na ordem dos payloads
+    for (int w = 0; w < thread_count; w++) {
+        if (device_name[0] == '\0' && workers[w].device_name[0] != '\0') {
+            memcpy(device_name, workers[w].device_name, sizeof(workers[w].device_name));
+        }
+
+        if (profile) {
+            const GPMF_counters* c = &workers[w].counters;
+            profile->klvs_stepped += c->klv_steps;
+            profile->compressed_klvs += c->compressed_klvs;
+            profile->compressed_bytes += c->compressed_bytes;
+            profile->samples_scaled += c->samples_scaled;
+            profile->allocations += c->allocations;
+            profile->decompress_ns += c->decompress_ns;
+            profile->scale_ns += c->scale_ns;
+            profile->index_ns += workers[w].index_ns;
+            profile->accumulate_ns += workers[w].accumulate_ns;
+        }
+
+        for (int i = 0; i < workers[w].table.count; i++) {
+            ColumnAccumulator* src = &workers[w].table.accs[i];
+            ColumnAccumulator* dst = find_or_add_accumulator(table, src->device_id, src->fourcc, src->elements_per_sample);
+            if (dst) append_accumulator(dst, src);
+            free_accumulator(src);
+        }
+        arena_absorb(&table->arena, &workers[w].table.arena);
+    }
+    free(workers);
+
+    return table->count;
+}
+
+// MARK: - TIMESTAMPS
+
+// Taxa nominal, usada só quando o MP4 não tem tempos de payload (ex: GPMF em udta)
+static double nominal_sample_rate(const char* type) {
+    if (strncmp(type, "GPS", 3) == 0) return 18.0;
+    if (strncmp(type, "ACCL", 4) == 0) return 200.0;
+    if (strncmp(type, "GYRO", 4) == 0) return 200.0;
+    if (strncmp(type, "CORI", 4) == 0) return 30.0; // Orientação costuma ser mais lenta
+    return 1.0;
+}
+
+// Índice absoluto do primeiro sample do bloco (TSMP quando existe, senão a linha)
+static double anchor_sample_index(const TimeAnchor* anchor) {
+    if (anchor->has_tsmp && anchor->tsmp >= (uint32_t)anchor->count) return (double)(anchor->tsmp - (uint32_t)anchor->count);
+    return (double)anchor->first_row;
+}
+
+// Taxa pelo relógio da câmera entre dois blocos com STMP. A unidade do STMP não é
+// declarada (microssegundos nas câmeras atuais): vale a potência de 10 que deixa a taxa
+// a menos de 10% da taxa dos payloads MP4 (payload_rate 0 aceita a primeira).
+// Devolve 0 quando nenhuma escala serve.
+static double measure_stmp_rate(double stamped_samples, uint64_t stmp_span, double payload_rate, double* scale) {
+    for (double s = 1000000000.0; s >= 1.0 && stamped_samples > 0.0; s *= 0.1) {
+        double rate = stamped_samples / ((double)stmp_span / s);
+        if (payload_rate == 0.0 || (rate * 0.9 < payload_rate && payload_rate < rate * 1.1)) {
+            *scale = s;
+            return rate;
+        }
+    }
+    return 0.0;
+}
+
+// Preenche 'timestamps' do stream e devolve a taxa medida.
+// Com STMP em pelo menos dois blocos, cada bloco é posicionado pelo relógio da câmera
+// e a taxa vem de (samples entre STMPs) / (tempo entre STMPs), como em GetGPMFSampleRate.
+// Sem STMP, a taxa vem de samples / duração dos payloads MP4 (edit list incluída).
+static double resolve_timestamps(const ColumnAccumulator* acc, double* timestamps,
+                                 int has_base_stmp, uint64_t base_stmp, double edit_offset) {
+    const TimeAnchor* first = NULL;
+    const TimeAnchor* last = NULL;
+    const TimeAnchor* first_stmp = NULL;
+    const TimeAnchor* last_stmp = NULL;
+
+    for (int32_t a = 0; a < acc->anchor_count; a++) {
+        const TimeAnchor* anchor = &acc->anchors[a];
+        if (anchor->has_payload_time) {
+            if (!first) first = anchor;
+            last = anchor;
+        }
+        if (anchor->has_stmp) {
+            if (!first_stmp) first_stmp = anchor;
+            last_stmp = anchor;
+        }
+    }
+
+    // Sem tempos de payload: taxa nominal a partir de zero
+    if (!first) {
+        double rate = nominal_sample_rate(acc->type);
+        for (int32_t row = 0; row < acc->sample_count; row++) timestamps[row] = (double)row / rate;
+        return rate;
+    }
+
+    // Taxa aproximada pelos payloads MP4
+    double span = last->payload_out - first->payload_in;
+    int32_t span_samples = last->first_row + last->count - first->first_row;
+    double rate = span > 0.0 ? (double)span_samples / span : 0.0;
+
+    // Refina com o relógio da câmera (STMP em microssegundos nas câmeras atuais)
+    if (has_base_stmp && first_stmp && last_stmp && last_stmp != first_stmp && last_stmp->stmp > first_stmp->stmp) {
+        double scale = 1.0;
+        double stmp_rate = measure_stmp_rate(anchor_sample_index(last_stmp) - anchor_sample_index(first_stmp),
+                                             last_stmp->stmp - first_stmp->stmp, rate, &scale);
+
+        if (stmp_rate > 0.0) {
+            double period = 1.0 / stmp_rate;
+
+            for (int32_t a = 0; a < acc->anchor_count; a++) {
+                const TimeAnchor* anchor = &acc->anchors[a];
+                double start;
+                if (anchor->has_stmp) {
+                    start = edit_offset + (double)(anchor->stmp - base_stmp) / scale;
+                } else {
+                    // Bloco sem STMP: extrapola a partir do primeiro bloco com relógio
+                    start = edit_offset + (double)(first_stmp->stmp - base_stmp) / scale +
+                            (anchor_sample_index(anchor) - anchor_sample_index(first_stmp)) * period;
+                }
+                for (int32_t i = 0; i < anchor->count; i++) {
+                    timestamps[anchor->first_row + i] = start + (double)i * period;
                 }
             }
+            return stmp_rate;
+        }
+    }
+
+    if (rate <= 0.0) rate = nominal_sample_rate(acc->type);
+
+    for (int32_t row = 0; row < acc->sample_count; row++) {
+        timestamps[row] = first->payload_in + (double)(row - first->first_row) / rate;
+    }
+    return rate;
+}
+
+// MARK: - SESSÃO (UM OPEN POR ARQUIVO)
+
+struct C_GPMFSession {
+    SessionChapter* chapters; // Um por arquivo, na ordem da gravação
+    int32_t chapter_count;
+    char* file_path;       // Primeiro capítulo (cache e trace)
+    uint64_t open_start;   // Trace: span da abertura, emitido pela primeira extração rastreada
+    uint64_t open_end;
+    int open_traced;
+    uint32_t payload_count; // Soma dos capítulos
+    char device_name[32];
+    int device_name_ready;
+    C_GPMFStreamInfo* catalogue;
+    int32_t catalogue_count;
+    int catalogue_ready;
+};
+
+C_GPMFSession* gpmf_session_open(const char* file_path) {
+    return gpmf_session_open_chapters(&file_path, 1);
+}
+
+C_GPMFSession* gpmf_session_open_chapters(const char* const* file_paths, int32_t count) {
+    if (!file_paths || count <= 0 || count > UINT16_MAX) return NULL;
+    for (int32_t c = 0; c < count; c++) {
+        if (!file_paths[c]) return NULL;
+    }
+
+    uint64_t open_start = profile_clock();
+    C_GPMFSession* session = calloc(1, sizeof(C_GPMFSession));
+    SessionChapter* chapters = calloc((size_t)count, sizeof(SessionChapter));
+    if (!session || !chapters) {
+        free(session);
+        free(chapters);
+        return NULL;
+    }
+    session->chapters = chapters;
+
+    // Tabela de payloads concatenada: cada capítulo começa onde o anterior termina
+    uint32_t first_payload = 0;
+    double time_offset = 0.0;
+    for (int32_t c = 0; c < count; c++) {
+        size_t mp4Handle = open_gpmf_source(file_paths[c]);
+        if (!mp4Handle) {
+            gpmf_session_close(session);
+            return NULL;
+        }
+
+        SessionChapter* chapter = &chapters[c];
+        chapter->mp4Handle = mp4Handle;
+        chapter->first_payload = first_payload;
+        chapter->payload_count = GetNumberPayloads(mp4Handle);
+        chapter->time_offset = time_offset;
+        chapter->index = (uint16_t)c;
+        session->chapter_count = c + 1;
+
+        // Duração do capítulo: fim do último payload (precisão double), senão a da trilha
+        double in = 0.0, out = 0.0;
+        if (chapter->payload_count == 0 ||
+            GetPayloadTime(mp4Handle, chapter->payload_count - 1, &in, &out) != MP4_ERROR_OK) {
+            out = (double)GetDuration(mp4Handle);
+        }
+        time_offset += out;
+        first_payload += chapter->payload_count;
+    }
+
+    session->open_start = open_start;
+    session->open_end = profile_clock();
+    session->payload_count = first_payload;
+    session->file_path = strdup(file_paths[0]);
+    return session;
+}
+
+void gpmf_session_close(C_GPMFSession* session) {
+    if (!session) return;
+    for (int32_t c = 0; c < session->chapter_count; c++) CloseSource(session->chapters[c].mp4Handle);
+    free(session->chapters);
+    free(session->file_path);
+    free(session->catalogue);
+    free(session);
+}
+
+uint32_t gpmf_session_payload_count(const C_GPMFSession* session) {
+    return session ? session->payload_count : 0;
+}
+
+const char* gpmf_session_device_name(C_GPMFSession* session) {
+    if (!session) return NULL;
+
+    if (!session->device_name_ready) {
+        const SessionChapter* chapter = &session->chapters[0];
+        size_t payloadres = 0;
 
-            if (!ts && temp_stream_count < MAX_STREAM_TYPES) {
-                ts = &temp_streams[temp_stream_count++];
-                strncpy(ts->type, stream_type, 5);
-                ts->capacity = 1000;
-                ts->samples = calloc(ts->capacity, sizeof(C_GPMFSample));
-                
-                // Taxas estimadas (Mapper ajustará depois)
-                if (strncmp(stream_type, "GPS", 3) == 0) ts->sample_rate = 18.0;
-                else if (strncmp(stream_type, "ACCL", 4) == 0) ts->sample_rate = 200.0;
-                else if (strncmp(stream_type, "GYRO", 4) == 0) ts->sample_rate = 200.0;
-                else if (strncmp(stream_type, "CORI", 4) == 0) ts->sample_rate = 30.0; // Orientação costuma ser mais lenta
-                else ts->sample_rate = 1.0;
+        // Procura o nome apenas nos primeiros payloads (geralmente está no início)
+        for (uint32_t i = 0; i < chapter->payload_count && i < 5 && session->device_name[0] == '\0'; i++) {
+            uint32_t payloadSize = GetPayloadSize(chapter->mp4Handle, i);
+            if (payloadSize == 0) continue;
+
+            payloadres = GetPayloadResource(chapter->mp4Handle, payloadres, payloadSize);
+            uint32_t* payload = GetPayload(chapter->mp4Handle, payloadres, i);
+            if (!payload) continue;
+
+            GPMF_stream gs;
+            if (GPMF_Init(&gs, payload, payloadSize) != GPMF_OK) continue;
+
+            // DVNM em qualquer DEVC do payload
+            if (GPMF_FindNext(&gs, GPMF_KEY_DEVICE_NAME, GPMF_RECURSE_LEVELS) == GPMF_OK) {
+                GPMF_DeviceName(&gs, session->device_name, sizeof(session->device_name));
             }
+        }
+
+        if (payloadres) FreePayloadResource(chapter->mp4Handle, payloadres);
+        session->device_name_ready = 1;
+    }
 
-            if (!ts || !ts->samples) continue;
-
-            // Extração
-            uint32_t samples = GPMF_PayloadSampleCount(&data_stream);
-            uint32_t elements = GPMF_ElementsInStruct(&data_stream);
-
-            if (ts->elements_per_sample == 0) ts->elements_per_sample = elements;
-
-            if (samples > 0 && elements > 0 && elements <= 64) {
-                uint32_t buffersize = samples * elements * sizeof(double);
-                
-                if (buffersize > 0 && buffersize < 20000000) {
-                    double* temp_buffer = (double*)malloc(buffersize + 256);
-                    
-                    if (temp_buffer) {
-                        // GPMF_ScaledData converte tudo para Double (incluindo ISO, Shutter, etc)
-                        if (GPMF_ScaledData(&data_stream, temp_buffer, buffersize, 0, samples, GPMF_TYPE_DOUBLE) == GPMF_OK) {
-                            
-                            // Realocação Segura
-                            if (ts->sample_count + samples > ts->capacity) {
-                                ts->capacity += samples + 4000; // Crescimento mais agressivo
-                                C_GPMFSample* new_ptr = realloc(ts->samples, ts->capacity * sizeof(C_GPMFSample));
-                                if (new_ptr) ts->samples = new_ptr;
-                                else { free(temp_buffer); continue; }
-                            }
-
-                            // Cópia
-                            for (uint32_t i = 0; i < samples; i++) {
-                                C_GPMFSample* sample = &ts->samples[ts->sample_count++];
-                                strncpy(sample->type, stream_type, 5);
-                                sample->timestamp = (double)(ts->sample_count) / ts->sample_rate; // Timestamp simples (será refinado no Swift)
-                                
-                                for (uint32_t j = 0; j < elements && j < 16; j++) {
-                                    sample->values[j] = temp_buffer[i * elements + j];
-                                }
-                            }
-                        }
-                        free(temp_buffer);
+    return session->device_name[0] != '\0' ? session->device_name : NULL;
+}
+
+const C_GPMFStreamInfo* gpmf_session_catalogue(C_GPMFSession* session, int32_t* count) {
+    if (count) *count = 0;
+    if (!session) return NULL;
+
+    if (!session->catalogue_ready) {
+        C_GPMFStreamInfo infos[MAX_STREAM_TYPES];
+        int32_t info_count = 0;
+
+        // Só a estrutura KLV: nenhum stream é convertido
+        for (int32_t c = 0; c < session->chapter_count; c++) {
+            const SessionChapter* chapter = &session->chapters[c];
+            size_t payloadres = 0;
+
+            for (uint32_t i = 0; i < chapter->payload_count; i++) {
+                uint32_t payloadSize = GetPayloadSize(chapter->mp4Handle, i);
+                if (payloadSize == 0 || payloadSize > 10000000) continue;
+
+                payloadres = GetPayloadResource(chapter->mp4Handle, payloadres, payloadSize);
+                uint32_t* payload = GetPayload(chapter->mp4Handle, payloadres, i);
+                if (!payload) continue;
+
+                GPMF_stream gs;
+                if (GPMF_Init(&gs, payload, payloadSize) != GPMF_OK) continue;
+
+                while (GPMF_FindNext(&gs, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS) == GPMF_OK) {
+                    GPMF_stream data_stream;
+                    GPMF_CopyState(&gs, &data_stream);
+                    if (GPMF_SeekToSamples(&data_stream) != GPMF_OK) continue;
+
+                    uint32_t fourcc_key = GPMF_Key(&data_stream);
+                    if (fourcc_key == 0) continue;
+
+                    if (session->device_name[0] == '\0' && gs.device_name[0] != '\0') {
+                        memcpy(session->device_name, gs.device_name, sizeof(session->device_name));
+                        session->device_name_ready = 1;
+                    }
+
+                    C_GPMFStreamInfo* info = NULL;
+                    for (int32_t k = 0; k < info_count; k++) {
+                        if (memcmp(infos[k].type, &fourcc_key, 4) == 0 && infos[k].device_id == gs.device_id) { info = &infos[k]; break; }
+                    }
+                    if (!info) {
+                        if (info_count >= MAX_STREAM_TYPES) continue;
+                        info = &infos[info_count++];
+                        memset(info, 0, sizeof(C_GPMFStreamInfo));
+                        memcpy(info->type, &fourcc_key, 4);
+                        info->device_id = gs.device_id;
+                        info->elements_per_sample = (int32_t)GPMF_ElementsInStruct(&data_stream);
                     }
+
+                    info->total_samples += GPMF_PayloadSampleCount(&data_stream);
+                    info->payload_count++;
                 }
             }
+
+            if (payloadres) FreePayloadResource(chapter->mp4Handle, payloadres);
+        }
+
+        if (info_count > 0) {
+            session->catalogue = malloc((size_t)info_count * sizeof(C_GPMFStreamInfo));
+            if (session->catalogue) {
+                memcpy(session->catalogue, infos, (size_t)info_count * sizeof(C_GPMFStreamInfo));
+                session->catalogue_count = info_count;
+            }
+        }
+        session->catalogue_ready = 1;
+    }
+
+    if (count) *count = session->catalogue_count;
+    return session->catalogue;
+}
+
+// Payloads lidos, no máximo, à procura do primeiro STMP de um capítulo
+#define BASE_STMP_SEARCH_PAYLOADS 16
+
+// Zero do relógio da câmera num capítulo: menor STMP entre todos os STRMs do primeiro
+// payload que tenha STMP. Não depende do filtro de FourCC, então extrações filtradas,
+// completas e por intervalo compartilham a mesma base de tempo.
+static int chapter_base_stmp(const SessionChapter* chapter, uint64_t* base) {
+    size_t payloadres = 0;
+    int found = 0;
+
+    for (uint32_t index = 0; !found && index < chapter->payload_count && index < BASE_STMP_SEARCH_PAYLOADS; index++) {
+        uint32_t payloadSize = GetPayloadSize(chapter->mp4Handle, index);
+        if (payloadSize == 0 || payloadSize > 10000000) continue;
+
+        payloadres = GetPayloadResource(chapter->mp4Handle, payloadres, payloadSize);
+        uint32_t* payload = GetPayload(chapter->mp4Handle, payloadres, index);
+        GPMF_stream gs;
+        if (!payload || GPMF_Init(&gs, payload, payloadSize) != GPMF_OK) continue;
+
+        while (GPMF_FindNext(&gs, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS) == GPMF_OK) {
+            GPMF_stream data_stream;
+            GPMF_CopyState(&gs, &data_stream);
+            if (GPMF_SeekToSamples(&data_stream) != GPMF_OK) continue;
+
+            TimeAnchor anchor;
+            memset(&anchor, 0, sizeof(anchor));
+            read_block_clock(&data_stream, &anchor);
+            if (!anchor.has_stmp) continue;
+            if (!found || anchor.stmp < *base) *base = anchor.stmp;
+            found = 1;
+        }
+    }
+
+    if (payloadres) FreePayloadResource(chapter->mp4Handle, payloadres);
+    return found;
+}
+
+// Capítulo que contém o payload global (busca binária; capítulos vazios são pulados)
+static const SessionChapter* find_chapter(const C_GPMFSession* session, uint32_t payload_index) {
+    int32_t lo = 0, hi = session->chapter_count;
+    while (lo < hi) {
+        int32_t mid = lo + (hi - lo) / 2;
+        const SessionChapter* chapter = &session->chapters[mid];
+        if (chapter->first_payload + chapter->payload_count <= payload_index) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < session->chapter_count ? &session->chapters[lo] : NULL;
+}
+
+// Tempo MP4 de um payload global, deslocado pelos capítulos anteriores
+static int session_payload_time(const C_GPMFSession* session, uint32_t payload_index, double* in, double* out) {
+    const SessionChapter* chapter = find_chapter(session, payload_index);
+    if (!chapter || GetPayloadTime(chapter->mp4Handle, payload_index - chapter->first_payload, in, out) != MP4_ERROR_OK) return 0;
+    *in += chapter->time_offset;
+    *out += chapter->time_offset;
+    return 1;
+}
+
+// Leva os relógios dos capítulos para a timeline da sessão (âncoras já em ordem de payload).
+// STMP: o menor STMP de cada capítulo passa a valer o início do capítulo na timeline
+// (base do capítulo 0 + time_offset, em microssegundos como nas câmeras atuais), quer a
+// câmera reinicie o relógio a cada arquivo ou não.
+// TSMP: quando a contagem recomeça num capítulo, continua do total já visto no stream.
+static void stitch_chapter_clocks(const C_GPMFSession* session, ColumnAccumulator* accs, int acc_count) {
+    int32_t count = session->chapter_count;
+    uint64_t* bases = calloc((size_t)count, sizeof(uint64_t));
+    uint8_t* has_base = calloc((size_t)count, sizeof(uint8_t));
+
+    if (bases && has_base) {
+        for (int32_t c = 0; c < count; c++) has_base[c] = (uint8_t)chapter_base_stmp(&session->chapters[c], &bases[c]);
+    }
+
+    for (int i = 0; i < acc_count; i++) {
+        uint32_t tsmp_offset = 0, last_tsmp = 0;
+        uint16_t tsmp_chapter = 0;
+
+        for (int32_t a = 0; a < accs[i].anchor_count; a++) {
+            TimeAnchor* anchor = &accs[i].anchors[a];
+            uint16_t c = anchor->chapter;
+
+            if (anchor->has_stmp && c > 0) {
+                if (!bases || !has_base || !has_base[0] || !has_base[c] || anchor->stmp < bases[c]) {
+                    anchor->has_stmp = 0; // Sem referência: o bloco é extrapolado pelos vizinhos
+                } else {
+                    uint64_t start = bases[0] + (uint64_t)llround(session->chapters[c].time_offset * 1000000.0);
+                    anchor->stmp = anchor->stmp - bases[c] + start;
+                }
+            }
+
+            if (anchor->has_tsmp) {
+                if (c != tsmp_chapter) {
+                    if (anchor->tsmp + tsmp_offset <= last_tsmp) tsmp_offset = last_tsmp;
+                    tsmp_chapter = c;
+                }
+                anchor->tsmp += tsmp_offset;
+                last_tsmp = anchor->tsmp;
+            }
+        }
+    }
+
+    free(bases);
+    free(has_base);
+}
+
+// Payloads que cruzam [t0, t1], por busca binária nos tempos MP4 (crescentes com o índice).
+// A faixa ganha um payload de margem de cada lado: o relógio da câmera (STMP) pode
+// deslocar os samples alguns milissegundos em relação ao tempo MP4 do payload.
+// Sem tempos de payload (ex: GPMF em udta) devolve o arquivo inteiro.
+static void find_payload_range(const C_GPMFSession* session, double t0, double t1,
+                               uint32_t* first_payload, uint32_t* end_payload) {
+    uint32_t payload_count = session->payload_count;
+    double in = 0.0, out = 0.0;
+
+    *first_payload = 0;
+    *end_payload = payload_count;
+    if (payload_count == 0 || !session_payload_time(session, 0, &in, &out)) return;
+
+    // Primeiro payload que termina depois de t0
+    uint32_t lo = 0, hi = payload_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        session_payload_time(session, mid, &in, &out);
+        if (out <= t0) lo = mid + 1;
+        else hi = mid;
+    }
+    uint32_t first = lo;
+
+    // Primeiro payload que começa depois de t1
+    hi = payload_count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        session_payload_time(session, mid, &in, &out);
+        if (in <= t1) lo = mid + 1;
+        else hi = mid;
+    }
+    uint32_t end = lo;
+
+    *first_payload = first > 0 ? first - 1 : 0;
+    *end_payload = end < payload_count ? end + 1 : payload_count;
+}
+
+// Decodifica os payloads [first_payload, end_payload) e monta o conjunto colunar com os
+// samples cujos tempos caem em [t0, t1]. NULL se nada foi extraído.
+static C_GPMFColumnSet* extract_column_set(C_GPMFSession* session, uint32_t first_payload, uint32_t end_payload,
+                                           double t0, double t1, const C_GPMFParseOptions* options, GPMFTrace* trace) {
+    AccumulatorTable* table = calloc(1, sizeof(AccumulatorTable));
+    if (!table) return NULL;
+
+    // Perfil: leituras do mp4reader contadas só durante a decodificação (um contador por
+    // capítulo, já que capítulos diferentes são lidos em paralelo)
+    C_GPMFProfile* profile = options ? options->profile : NULL;
+    mp4counters* reads = profile ? calloc((size_t)session->chapter_count, sizeof(mp4counters)) : NULL;
+    for (int32_t c = 0; reads && c < session->chapter_count; c++) SetMP4Counters(session->chapters[c].mp4Handle, &reads[c]);
+
+    double edit_offset = 0.0;
+    char device_name[32] = { 0 };
+    int acc_count = extract_columns(session->chapters, session->chapter_count, first_payload, end_payload, options, trace,
+                                    table, &edit_offset, device_name);
+    ColumnAccumulator* accs = table->accs;
+
+    uint64_t finalize_start = trace ? profile_clock() : 0;
+    if (profile) {
+        for (int32_t c = 0; reads && c < session->chapter_count; c++) {
+            SetMP4Counters(session->chapters[c].mp4Handle, NULL);
+            profile->atoms_visited += reads[c].atoms;
+            profile->open_ns += reads[c].open_ns;
+            profile->payloads_visited += reads[c].payloads;
+            profile->bytes_read += reads[c].bytes_read;
+            profile->bytes_mapped += reads[c].bytes_mapped;
+            profile->read_ns += reads[c].read_ns;
+            profile->allocations += reads[c].allocations;
+        }
+        free(reads);
+        profile->allocations += arena_block_count(&table->arena);
+        finalize_start = profile_clock();
+    }
+
+    // DVNM sai de graça da passada principal
+    if (session->device_name[0] == '\0' && device_name[0] != '\0') {
+        memcpy(session->device_name, device_name, sizeof(device_name));
+        session->device_name_ready = 1;
+    }
+
+    if (acc_count <= 0) {
+        arena_free(&table->arena);
+        free(table);
+        return NULL;
+    }
+
+    if (session->chapter_count > 1) stitch_chapter_clocks(session, accs, acc_count);
+
+    // Zero do relógio: sempre o do primeiro capítulo, calculado sobre todos os STRMs,
+    // para que faixas e filtros deem os mesmos tempos da extração completa
+    uint64_t base_stmp = 0;
+    int has_base_stmp = chapter_base_stmp(&session->chapters[0], &base_stmp);
+
+    C_GPMFColumnSet* set = calloc(1, sizeof(C_GPMFColumnSet));
+    C_GPMFColumnStream* streams = calloc((size_t)acc_count, sizeof(C_GPMFColumnStream));
+    if (!set || !streams) {
+        free(set);
+        free(streams);
+        for (int i = 0; i < acc_count; i++) free_accumulator(&accs[i]);
+        arena_free(&table->arena);
+        free(table);
+        return NULL;
+    }
+
+    // Finalização: cada stream vira um bloco exato (tempo + colunas), recortado em [t0, t1]
+    int32_t out = 0;
+    for (int i = 0; i < acc_count; i++) {
+        ColumnAccumulator* acc = &accs[i];
+        size_t count = (size_t)acc->sample_count;
+        size_t elements = (size_t)acc->elements_per_sample;
+
+        if (count == 0) {
+            free_accumulator(acc);
+            continue;
+        }
+
+        C_GPMFColumnStream* cs = &streams[out];
+        cs->timestamps = malloc(count * sizeof(double));
+        if (!cs->timestamps) {
+            free_accumulator(acc);
+            continue;
+        }
+
+        double rate = resolve_timestamps(acc, cs->timestamps, has_base_stmp, base_stmp, edit_offset);
+
+        // Recorte: os tempos crescem ao longo da coluna, basta achar as pontas
+        size_t first = 0, end = count;
+        while (first < end && cs->timestamps[first] < t0) first++;
+        while (end > first && cs->timestamps[end - 1] > t1) end--;
+        if (first == end) {
+            free(cs->timestamps);
+            memset(cs, 0, sizeof(C_GPMFColumnStream));
+            free_accumulator(acc);
+            continue;
+        }
+        if (first > 0 || end < count) {
+            memmove(cs->timestamps, cs->timestamps + first, (end - first) * sizeof(double));
+            count = end - first;
+        }
+
+        cs->values = malloc(count * elements * sizeof(double));
+        if (!cs->values) {
+            free(cs->timestamps);
+            memset(cs, 0, sizeof(C_GPMFColumnStream));
+            free_accumulator(acc);
+            continue;
+        }
+
+        for (size_t j = 0; j < elements; j++) {
+            copy_accumulator_column(acc, (int32_t)j, first, count, cs->values + j * count);
+        }
+
+        strncpy(cs->type, acc->type, 5);
+        cs->device_id = acc->device_id;
+        cs->sample_count = (int32_t)count;
+        cs->elements_per_sample = acc->elements_per_sample;
+        cs->sample_rate = rate;
+        free_accumulator(acc);
+        out++;
+    }
+
+    arena_free(&table->arena);
+    free(table);
+
+    set->streams = streams;
+    set->stream_count = out;
+    if (profile || trace) {
+        uint64_t finalize_end = profile_clock();
+        if (profile) profile->finalize_ns = finalize_end - finalize_start;
+        gpmf_trace_span(trace ? &trace->threads[0] : NULL, "finalize", finalize_start, finalize_end, -1, 0, 0, 0);
+    }
+    return set;
+}
+
+// Trace de uma extração da sessão: a abertura entra uma única vez, na primeira
+static GPMFTrace* session_trace_begin(C_GPMFSession* session) {
+    GPMFTrace* trace = gpmf_trace_begin();
+    if (trace && !session->open_traced) {
+        gpmf_trace_span(&trace->threads[0], "open", session->open_start, session->open_end, -1, 0, 0, 0);
+        session->open_traced = 1;
+    }
+    return trace;
+}
+
+static void session_trace_end(C_GPMFSession* session, GPMFTrace* trace, const char* name, uint64_t start) {
+    if (!trace) return;
+    gpmf_trace_span(&trace->threads[0], name, start, profile_clock(), -1, 0, 0, 0);
+    gpmf_trace_end(trace, session->file_path);
+}
+
+C_GPMFColumnSet* gpmf_session_parse_columns(C_GPMFSession* session, const C_GPMFParseOptions* options) {
+    if (!session) return NULL;
+
+    C_GPMFProfile* profile = options ? options->profile : NULL;
+    GPMFTrace* trace = session_trace_begin(session);
+    uint64_t start = (profile || trace) ? profile_clock() : 0;
+    if (profile) memset(profile, 0, sizeof(C_GPMFProfile));
+
+    // Cache decodificado: cada filtro é uma variante separada do mesmo arquivo.
+    // Sessões com capítulos não usam o cache (a validade depende de todos os arquivos).
+    const char* variant = (options && options->fourcc_filter) ? options->fourcc_filter : "";
+    int cacheable = session->chapter_count == 1;
+    char cached_name[32] = { 0 };
+    C_GPMFColumnSet* cached = cacheable ? gpmf_cache_load(session->file_path, variant, cached_name) : NULL;
+    if (cached) {
+        if (session->device_name[0] == '\0' && cached_name[0] != '\0') {
+            memcpy(session->device_name, cached_name, sizeof(cached_name));
+            session->device_name_ready = 1;
+        }
+        if (profile) {
+            profile->from_cache = 1;
+            profile->total_ns = profile_clock() - start;
+        }
+        session_trace_end(session, trace, "cache", start);
+        return cached;
+    }
+
+    C_GPMFColumnSet* set = extract_column_set(session, 0, session->payload_count, -HUGE_VAL, HUGE_VAL, options, trace);
+    if (profile) profile->total_ns = profile_clock() - start;
+    session_trace_end(session, trace, "parse", start);
+    if (!set) return NULL;
+
+    if (cacheable) gpmf_cache_store(session->file_path, variant, set, session->device_name);
+    return set;
+}
+
+C_GPMFColumnSet* gpmf_session_parse_range(C_GPMFSession* session, double t0, double t1, const C_GPMFParseOptions* options) {
+    if (!session || !(t0 <= t1)) return NULL;
+
+    C_GPMFProfile* profile = options ? options->profile : NULL;
+    uint64_t start = profile ? profile_clock() : 0;
+    if (profile) memset(profile, 0, sizeof(C_GPMFProfile));
+
+    uint32_t first_payload, end_payload;
+    find_payload_range(session, t0, t1, &first_payload, &end_payload);
+    if (first_payload >= end_payload) return NULL;
+
+    GPMFTrace* trace = session_trace_begin(session);
+    if (trace && !profile) start = profile_clock();
+
+    C_GPMFColumnSet* set = extract_column_set(session, first_payload, end_payload, t0, t1, options, trace);
+    if (profile) profile->total_ns = profile_clock() - start;
+    session_trace_end(session, trace, "parse_range", start);
+    if (set && set->stream_count == 0) {
+        free_column_set(set);
+        return NULL;
+    }
+    return set;
+}
+
+C_GPMFColumnSet* parse_gpmf_columns_with_options(const char* file_path, const C_GPMFParseOptions* options) {
+    C_GPMFSession* session = gpmf_session_open(file_path);
+    if (!session) return NULL;
+
+    C_GPMFColumnSet* set = gpmf_session_parse_columns(session, options);
+    gpmf_session_close(session);
+    return set;
+}
+
+C_GPMFColumnSet* parse_gpmf_columns_from_file(const char* file_path) {
+    return parse_gpmf_columns_with_options(file_path, NULL);
+}
+
+// MARK: - STREAMING (INCREMENTAL)
+
+// Relógio de um stream na leitura incremental: o mesmo cálculo de resolve_timestamps,
+// feito com os blocos vistos até agora
+typedef struct {
+    uint32_t device_id;
+    uint32_t fourcc;
+    int32_t rows;          // Samples já entregues (first_row do próximo bloco)
+    TimeAnchor first_stmp; // Primeiro bloco com STMP
+    int has_first_stmp;
+    double rate;           // Taxa medida entre STMPs (0 = ainda sem medida)
+    double scale;          // Unidade do STMP que acompanha 'rate'
+} StreamClock;
+
+// Estado da leitura incremental: bloco colunar reaproveitado entre callbacks
+typedef struct {
+    C_GPMFBlockCallback callback;
+    void* user_context;
+    uint32_t payload_index;
+    uint32_t payload_count;
+    double* timestamps;
+    double* values;
+    uint32_t capacity;     // Em samples * elementos
+    uint64_t base_stmp;
+    int has_base_stmp;
+    double edit_offset;
+    StreamClock* clocks;
+    int32_t clock_count;
+    int failed;            // Faltou memória: a leitura foi interrompida
+} StreamContext;
+
+static StreamClock* find_or_add_clock(StreamContext* ctx, uint32_t device_id, uint32_t fourcc) {
+    for (int32_t i = 0; i < ctx->clock_count; i++) {
+        if (ctx->clocks[i].device_id == device_id && ctx->clocks[i].fourcc == fourcc) return &ctx->clocks[i];
+    }
+
+    StreamClock* clocks = realloc(ctx->clocks, (size_t)(ctx->clock_count + 1) * sizeof(StreamClock));
+    if (!clocks) return NULL;
+    ctx->clocks = clocks;
+
+    StreamClock* clock = &clocks[ctx->clock_count++];
+    memset(clock, 0, sizeof(*clock));
+    clock->device_id = device_id;
+    clock->fourcc = fourcc;
+    return clock;
+}
+
+// Menor STMP de um payload (zero do relógio da câmera para a leitura incremental)
+static int find_payload_base_stmp(uint32_t* payload, uint32_t payloadSize, uint64_t* base) {
+    GPMF_stream gs;
+    if (GPMF_Init(&gs, payload, payloadSize) != GPMF_OK) return 0;
+
+    int found = 0;
+    while (GPMF_FindNext(&gs, GPMF_KEY_TIME_STAMP, GPMF_RECURSE_LEVELS | GPMF_TOLERANT) == GPMF_OK) {
+        if (GPMF_RawDataSize(&gs) < 8) continue;
+        uint64_t raw;
+        memcpy(&raw, GPMF_RawData(&gs), sizeof(raw));
+        uint64_t stmp = BYTESWAP64(raw);
+        if (!found || stmp < *base) *base = stmp;
+        found = 1;
+    }
+    return found;
+}
+
+// Sink da leitura incremental: converte o bloco para colunas e chama o callback.
+// Os tempos seguem resolve_timestamps, mas a taxa entre STMPs é medida do primeiro
+// bloco com STMP do stream até o bloco atual; até haver dois STMPs vale a taxa do payload.
+// Sem memória a leitura é interrompida e marcada como falha.
+static int emit_block(void* context, const DecodedBlock* block) {
+    StreamContext* ctx = (StreamContext*)context;
+    uint32_t samples = block->samples;
+    uint32_t elements = block->elements;
+
+    if (samples * elements > ctx->capacity) {
+        uint32_t new_capacity = samples * elements + 1024;
+        double* values = realloc(ctx->values, (size_t)new_capacity * sizeof(double));
+        if (values) ctx->values = values;
+        double* times = realloc(ctx->timestamps, (size_t)new_capacity * sizeof(double));
+        if (times) ctx->timestamps = times;
+        if (!values || !times) {
+            ctx->failed = 1;
+            return 0;
+        }
+        ctx->capacity = new_capacity;
+    }
+
+    StreamClock* clock = find_or_add_clock(ctx, block->device_id, block->fourcc);
+    if (!clock) {
+        ctx->failed = 1;
+        return 0;
+    }
+
+    TimeAnchor anchor = block->anchor;
+    anchor.first_row = clock->rows;
+    clock->rows += (int32_t)samples;
+
+    // Sem STMP: taxa da duração do payload, ou nominal a partir de zero sem tempos MP4
+    double payload_rate = 0.0;
+    if (anchor.has_payload_time && anchor.payload_out > anchor.payload_in) {
+        payload_rate = (double)samples / (anchor.payload_out - anchor.payload_in);
+    }
+    double rate = payload_rate > 0.0 ? payload_rate : nominal_sample_rate(block->type);
+    double start = anchor.has_payload_time ? anchor.payload_in : (double)anchor.first_row / rate;
+
+    if (ctx->has_base_stmp && anchor.has_stmp && anchor.stmp >= ctx->base_stmp) {
+        if (!clock->has_first_stmp) {
+            clock->first_stmp = anchor;
+            clock->has_first_stmp = 1;
+        } else if (anchor.stmp > clock->first_stmp.stmp) {
+            double scale = 1.0;
+            double stmp_rate = measure_stmp_rate(anchor_sample_index(&anchor) - anchor_sample_index(&clock->first_stmp),
+                                                 anchor.stmp - clock->first_stmp.stmp, payload_rate, &scale);
+            if (stmp_rate > 0.0) {
+                clock->rate = stmp_rate;
+                clock->scale = scale;
+            }
+        }
+    }
+
+    if (clock->rate > 0.0) {
+        rate = clock->rate;
+        const TimeAnchor* first = &clock->first_stmp;
+        if (anchor.has_stmp && anchor.stmp >= ctx->base_stmp) {
+            start = ctx->edit_offset + (double)(anchor.stmp - ctx->base_stmp) / clock->scale;
+        } else {
+            // Bloco sem STMP: extrapola a partir do primeiro bloco com relógio
+            start = ctx->edit_offset + (double)(first->stmp - ctx->base_stmp) / clock->scale +
+                    (anchor_sample_index(&anchor) - anchor_sample_index(first)) / rate;
+        }
+    } else if (clock->has_first_stmp && anchor.has_stmp && anchor.stmp >= ctx->base_stmp) {
+        // Um só STMP até aqui: microssegundos, a unidade das câmeras atuais
+        start = ctx->edit_offset + (double)(anchor.stmp - ctx->base_stmp) / 1000000.0;
+    }
+
+    double period = 1.0 / rate;
+    for (uint32_t i = 0; i < samples; i++) {
+        ctx->timestamps[i] = start + (double)i * period;
+        for (uint32_t j = 0; j < elements; j++) {
+            ctx->values[j * samples + i] = block->data[i * elements + j];
         }
     }
 
+    C_GPMFSampleBlock out;
+    memset(&out, 0, sizeof(out));
+    memcpy(out.type, block->type, 5);
+    out.device_id = block->device_id;
+    out.payload_index = ctx->payload_index;
+    out.payload_count = ctx->payload_count;
+    out.timestamps = ctx->timestamps;
+    out.values = ctx->values;
+    out.sample_count = (int32_t)samples;
+    out.elements_per_sample = (int32_t)elements;
+
+    return ctx->callback(&out, ctx->user_context) != 0;
+}
+
+int32_t parse_gpmf_blocks_from_file(const char* file_path, C_GPMFBlockCallback callback, void* context) {
+    if (!file_path || !callback) return -1;
+
+    size_t mp4Handle = open_gpmf_source(file_path);
+    if (!mp4Handle) return -1;
+
+    StreamContext ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.callback = callback;
+    ctx.user_context = context;
+    ctx.payload_count = GetNumberPayloads(mp4Handle);
+    if (GetEditListOffset(mp4Handle, &ctx.edit_offset) != MP4_ERROR_OK) ctx.edit_offset = 0.0;
+
+    SessionChapter chapter;
+    memset(&chapter, 0, sizeof(chapter));
+    chapter.mp4Handle = mp4Handle;
+    chapter.payload_count = ctx.payload_count;
+
+    DecodeScratch scratch;
+    memset(&scratch, 0, sizeof(scratch));
+    size_t payloadres = 0;
+    int32_t processed = 0;
+
+    // Loop de Payloads (um payload em memória por vez)
+    for (uint32_t payload_index = 0; payload_index < ctx.payload_count; payload_index++) {
+        uint32_t payloadSize = GetPayloadSize(mp4Handle, payload_index);
+        if (payloadSize == 0 || payloadSize > 10000000) continue;
+
+        payloadres = GetPayloadResource(mp4Handle, payloadres, payloadSize);
+        uint32_t* payload = GetPayload(mp4Handle, payloadres, payload_index);
+        if (!payload) continue;
+
+        if (!ctx.has_base_stmp) {
+            ctx.has_base_stmp = find_payload_base_stmp(payload, payloadSize, &ctx.base_stmp);
+        }
+
+        ctx.payload_index = payload_index;
+        processed++;
+        if (!decode_payload(&chapter, payload_index, payload, payloadSize, NULL, &scratch, emit_block, &ctx)) break;
+    }
+
+    free(ctx.timestamps);
+    free(ctx.values);
+    free(ctx.clocks);
+    free_scratch(&scratch);
     if (payloadres) FreePayloadResource(mp4Handle, payloadres);
     CloseSource(mp4Handle);
 
-    // Finalização
-    C_GPMFStream* streams = calloc(temp_stream_count + 1, sizeof(C_GPMFStream));
+    return ctx.failed ? -1 : processed;
+}
+
+// Mantido por compatibilidade: converte o resultado colunar para o layout antigo (um C_GPMFSample por ponto)
+C_GPMFStream* parse_gpmf_from_file(const char* file_path) {
+    C_GPMFColumnSet* set = parse_gpmf_columns_from_file(file_path);
+    if (!set) return NULL;
+
+    C_GPMFStream* streams = calloc((size_t)set->stream_count + 1, sizeof(C_GPMFStream));
     if (!streams) {
-        for (int i = 0; i < temp_stream_count; i++) if (temp_streams[i].samples) free(temp_streams[i].samples);
+        free_column_set(set);
         return NULL;
     }
 
-    for (int i = 0; i < temp_stream_count; i++) {
-        strncpy(streams[i].type, temp_streams[i].type, 5);
-        streams[i].samples = temp_streams[i].samples;
-        streams[i].sample_count = temp_streams[i].sample_count;
-        streams[i].elements_per_sample = temp_streams[i].elements_per_sample;
-        streams[i].sample_rate = temp_streams[i].sample_rate;
+    int32_t out = 0;
+    for (int32_t i = 0; i < set->stream_count; i++) {
+        C_GPMFColumnStream* cs = &set->streams[i];
+        C_GPMFSample* samples = calloc((size_t)cs->sample_count, sizeof(C_GPMFSample));
+        if (!samples) continue;
+
+        for (int32_t s = 0; s < cs->sample_count; s++) {
+            strncpy(samples[s].type, cs->type, 5);
+            samples[s].timestamp = cs->timestamps[s];
+            for (int32_t j = 0; j < cs->elements_per_sample && j < 16; j++) {
+                samples[s].values[j] = cs->values[(size_t)j * (size_t)cs->sample_count + (size_t)s];
+            }
+        }
+
+        strncpy(streams[out].type, cs->type, 5);
+        streams[out].samples = samples;
+        streams[out].sample_count = cs->sample_count;
+        streams[out].elements_per_sample = cs->elements_per_sample;
+        streams[out].sample_rate = cs->sample_rate;
+        out++;
     }
 
-    streams[temp_stream_count].type[0] = '\0';
-    
+    streams[out].type[0] = '\0';
+    free_column_set(set);
+
     return streams;
 }
 
@@ -246,3 +1671,27 @@ void free_parsed_streams(C_GPMFStream* streams) {
     }
     free(streams);
 }
+
+C_GPMFColumnSet* gpmf_column_set_retain(C_GPMFColumnSet* set) {
+    if (set) __atomic_fetch_add(&set->extra_refs, 1, __ATOMIC_RELAXED);
+    return set;
+}
+
+void free_column_set(C_GPMFColumnSet* set) {
+    if (!set) return;
+
+    // Ainda há outras referências: só a última libera
+    if (__atomic_fetch_sub(&set->extra_refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+
+    if (set->storage) {
+        // Colunas apontam para o mapa do cache
+        gpmf_cache_release(set->storage);
+    } else {
+        for (int32_t i = 0; i < set->stream_count; i++) {
+            free(set->streams[i].timestamps);
+            free(set->streams[i].values);
+        }
+    }
+    free(set->streams);
+    free(set);
+}
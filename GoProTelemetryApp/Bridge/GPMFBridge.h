@@ -34,11 +34,179 @@ typedef struct {
     double sample_rate;    // Frequência aproximada (Hz)
 } C_GPMFStream;
 
+/*
+ * C_GPMFColumnStream
+ * Mesmo stream em formato colunar (structure-of-arrays), com tamanho exato.
+ * 'timestamps' tem sample_count posições. 'values' guarda elements_per_sample
+ * colunas contíguas de sample_count doubles: a coluna j começa em
+ * values + j * sample_count.
+ * Os tempos vêm do relógio da câmera (STMP/TSMP) quando disponível, ou dos
+ * tempos dos payloads MP4, já com o offset da edit list aplicado.
+ */
+typedef struct {
+    char type[5];
+    uint32_t device_id;    // DVID do dispositivo de origem (câmera = 1, sensores externos têm outro)
+    double* timestamps;    // Coluna de tempos (segundos, timeline do vídeo)
+    double* values;        // Colunas de valores, uma após a outra
+    int32_t sample_count;
+    int32_t elements_per_sample;
+    double sample_rate;    // Frequência medida (Hz)
+} C_GPMFColumnStream;
+
+/*
+ * C_GPMFColumnSet
+ * Conjunto de streams colunares devolvido pelo parser.
+ * Contado por referência: as colunas ficam no mesmo endereço até a última
+ * referência ser liberada, então podem ser emprestadas sem cópia (ex: Swift).
+ */
+typedef struct {
+    C_GPMFColumnStream* streams;
+    int32_t stream_count;
+    void* storage;         // Interno: mapa do cache em disco quando veio de lá (NULL = memória própria)
+    int32_t extra_refs;    // Interno: referências além da original (gpmf_column_set_retain)
+} C_GPMFColumnSet;
+
+/*
+ * C_GPMFProfile
+ * Perfil de uma extração: volume processado e tempo por estágio, em ns.
+ * Estágios que rodam nos workers somam o tempo de todas as threads, então
+ * podem passar de total_ns numa extração paralela.
+ */
+typedef struct {
+    uint64_t atoms_visited;      // Átomos lidos na abertura (0 quando o índice veio do sidecar)
+    uint64_t payloads_visited;   // Payloads entregues pelo mp4reader
+    uint64_t bytes_read;         // Bytes de payload lidos com fread
+    uint64_t bytes_mapped;       // Bytes de payload servidos pelo mapeamento do arquivo
+    uint64_t klvs_stepped;       // KLVs percorridos por GPMF_Next
+    uint64_t compressed_klvs;    // KLVs '#' descomprimidos
+    uint64_t compressed_bytes;   // Bytes comprimidos decodificados
+    uint64_t samples_scaled;     // Samples convertidos por GPMF_ScaledData
+    uint64_t allocations;        // Buffers do parser e do mp4reader + blocos da arena
+    uint64_t open_ns;            // Abertura do MP4 (atom walk ou sidecar)
+    uint64_t read_ns;            // Leitura dos payloads (GetPayload)
+    uint64_t index_ns;           // Índice de STRM por payload (GPMF_BuildIndex)
+    uint64_t decompress_ns;      // Descompressão '#'
+    uint64_t scale_ns;           // GPMF_ScaledData (inclui a descompressão)
+    uint64_t accumulate_ns;      // Transposição para as colunas
+    uint64_t finalize_ns;        // Timestamps e montagem do conjunto colunar
+    uint64_t total_ns;           // Tempo de parede da extração (sem a abertura)
+    int32_t thread_count;        // Workers usados
+    int32_t from_cache;          // 1 = colunas vieram do cache em disco (nada foi decodificado)
+} C_GPMFProfile;
+
+/*
+ * C_GPMFParseOptions
+ * Ajustes da extração. Zerado (ou NULL) usa os valores padrão.
+ */
+typedef struct {
+    int32_t thread_count;  // Workers de decodificação (0 = núcleos disponíveis, 1 = serial)
+    const char* fourcc_filter; // Streams a extrair, ex: "GPS5,GPS9" (NULL = todos; nome curto = prefixo)
+    C_GPMFProfile* profile; // Opcional: recebe contadores e tempos desta extração (NULL = sem medição)
+} C_GPMFParseOptions;
+
+/*
+ * C_GPMFSampleBlock
+ * Samples de um stream dentro de um payload (leitura incremental), no mesmo
+ * layout colunar de C_GPMFColumnStream. Os ponteiros só valem durante o
+ * callback: copie o que precisar manter.
+ */
+typedef struct {
+    char type[5];
+    uint32_t device_id;
+    uint32_t payload_index;      // Payload de origem
+    uint32_t payload_count;      // Total de payloads do arquivo (para progresso)
+    const double* timestamps;
+    const double* values;        // Coluna j começa em values + j * sample_count
+    int32_t sample_count;
+    int32_t elements_per_sample;
+} C_GPMFSampleBlock;
+
+// Recebe cada bloco decodificado. Retornar 0 cancela a leitura.
+typedef int32_t (*C_GPMFBlockCallback)(const C_GPMFSampleBlock* block, void* context);
+
+/*
+ * C_GPMFStreamInfo
+ * Entrada do catálogo de streams de um arquivo (sem decodificar os dados).
+ */
+typedef struct {
+    char type[5];
+    uint32_t device_id;
+    int32_t elements_per_sample;
+    uint32_t total_samples;      // Soma dos samples em todos os payloads
+    uint32_t payload_count;      // Payloads que contêm o stream
+} C_GPMFStreamInfo;
+
+/*
+ * C_GPMFSession
+ * Arquivo aberto uma única vez: nome da câmera, catálogo e samples saem do
+ * mesmo índice MP4. Opaco para o Swift.
+ */
+typedef struct C_GPMFSession C_GPMFSession;
+
 // MARK: - FUNÇÕES EXPORTADAS
 
+// Define o diretório de cache em disco (NULL desativa). Chamar antes de abrir arquivos.
+// O índice de payloads e as colunas decodificadas de cada MP4 são salvos ali,
+// chaveados por caminho, tamanho e mtime.
+void gpmf_set_cache_directory(const char* directory);
+
+// Grava spans de cada extração (open, read, index, decode, scale, accumulate...) em
+// formato Chrome trace JSON, para abrir em chrome://tracing ou ui.perfetto.dev.
+// Extrações seguintes são anexadas ao mesmo arquivo. NULL desativa.
+void gpmf_set_trace_file(const char* path);
+
 // Extrai TODOS os streams de telemetria (GPS, IMU, Câmera, etc)
 C_GPMFStream* parse_gpmf_from_file(const char* file_path);
 
+// Extrai TODOS os streams em formato colunar (sem padding por sample)
+C_GPMFColumnSet* parse_gpmf_columns_from_file(const char* file_path);
+
+// Igual à anterior, com opções (ex: número de threads, filtro de streams). Payloads
+// são divididos entre os workers e o resultado mantém a ordem dos payloads.
+// Streams fora do filtro não são convertidos (nem escala, nem descompressão).
+C_GPMFColumnSet* parse_gpmf_columns_with_options(const char* file_path, const C_GPMFParseOptions* options);
+
+// Sessão: abre o MP4 (índice de payloads) uma vez. NULL se não há trilha GPMF.
+C_GPMFSession* gpmf_session_open(const char* file_path);
+
+// Abre uma gravação dividida em capítulos (GX01xxxx.MP4, GX02xxxx.MP4, ...) como uma sessão
+// só, com os arquivos na ordem da gravação. Os payloads são concatenados, os tempos de cada
+// capítulo começam onde o anterior termina e o TSMP continua a contagem. As funções de sessão
+// abaixo tratam o resultado como um único arquivo e os workers decodificam capítulos em
+// paralelo. NULL se algum capítulo não abrir. Essas sessões não usam o cache em disco de colunas.
+C_GPMFSession* gpmf_session_open_chapters(const char* const* file_paths, int32_t count);
+void gpmf_session_close(C_GPMFSession* session);
+
+uint32_t gpmf_session_payload_count(const C_GPMFSession* session);
+
+// Nome da câmera (DVNM). A string pertence à sessão; NULL se ausente.
+// Depois de gpmf_session_parse_columns o nome já vem da passada principal.
+const char* gpmf_session_device_name(C_GPMFSession* session);
+
+// Catálogo de streams (tipo, elementos, total de samples). Pertence à sessão.
+const C_GPMFStreamInfo* gpmf_session_catalogue(C_GPMFSession* session, int32_t* count);
+
+// Extração colunar sobre a sessão aberta. Liberar com free_column_set.
+// Com diretório de cache definido, o resultado é gravado na primeira extração e
+// mapeado de volta nas seguintes (sem decodificar).
+C_GPMFColumnSet* gpmf_session_parse_columns(C_GPMFSession* session, const C_GPMFParseOptions* options);
+
+// Extração de um intervalo [t0, t1] (segundos, mesma timeline de gpmf_session_parse_columns).
+// Só os payloads que cruzam o intervalo são lidos (busca binária nos tempos MP4) e os
+// samples são recortados exatamente em [t0, t1]: o custo é proporcional ao trecho, não ao
+// arquivo. Não passa pelo cache em disco. NULL se não há samples no intervalo.
+// Liberar com free_column_set.
+C_GPMFColumnSet* gpmf_session_parse_range(C_GPMFSession* session, double t0, double t1, const C_GPMFParseOptions* options);
+
+// Leitura incremental: decodifica payload a payload, na ordem do arquivo, e entrega
+// cada bloco ao callback assim que fica pronto. A memória usada é a de um payload.
+// Os tempos seguem a extração colunar, mas a taxa medida entre STMPs só usa os blocos
+// já lidos (até o segundo STMP do stream vale a duração do payload), então os primeiros
+// blocos podem diferir levemente de parse_gpmf_columns_from_file.
+// Retorna a quantidade de payloads lidos, ou -1 se o arquivo não pôde ser aberto ou
+// faltou memória no meio da leitura (os blocos já entregues continuam válidos).
+int32_t parse_gpmf_blocks_from_file(const char* file_path, C_GPMFBlockCallback callback, void* context);
+
 // Extrai apenas o Nome do Dispositivo (ex: "HERO11 Black")
 // O caller é responsável por dar free() na string retornada.
 char* get_device_name(const char* file_path);
@@ -49,4 +217,10 @@ int has_gpmf_stream(const char* file_path);
 // Limpeza de memória dos streams (Chamar no defer do Swift)
 void free_parsed_streams(C_GPMFStream* streams);
 
+// Nova referência ao conjunto (thread-safe). Cada retain pede um free_column_set.
+C_GPMFColumnSet* gpmf_column_set_retain(C_GPMFColumnSet* set);
+
+// Libera uma referência do conjunto colunar; a memória vai embora com a última
+void free_column_set(C_GPMFColumnSet* set);
+
 #endif /* GPMFBridge_h */
@@ -0,0 +1,290 @@
+//
+//  GPMFCache.c
+//  Cache binário da telemetria decodificada
+//
+//  Layout (tudo em ordem nativa, alinhado em 8 bytes):
+//    DecodedCacheHeader | caminho | variante | DecodedCacheStream[stream_count] | colunas
+//  Cada stream guarda o offset da coluna de tempos e do bloco de valores
+//  (mesmo layout de C_GPMFColumnStream), então a leitura é só um mmap.
+//
+
+#include "GPMFCache.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Incrementar sempre que a extração mudar o conteúdo das colunas
+#define DECODED_CACHE_MAGIC   0x43445047u // "GPDC"
+#define DECODED_CACHE_VERSION 3  // 3: base de STMP independente do filtro de FourCC
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t total_size;       // Tamanho do arquivo de cache (confere truncamento)
+    uint64_t source_size;
+    int64_t source_mtime;
+    uint32_t path_length;
+    uint32_t variant_length;
+    int32_t stream_count;
+    uint32_t source_mtime_nsec; // 0 nos caches antigos: só invalida fontes com mtime fracionário
+    char device_name[32];
+} DecodedCacheHeader;
+
+typedef struct {
+    char type[8];
+    uint32_t device_id;
+    uint32_t reserved;
+    int32_t sample_count;
+    int32_t elements_per_sample;
+    double sample_rate;
+    uint64_t timestamps_offset;
+    uint64_t values_offset;
+} DecodedCacheStream;
+
+static char cache_directory[1024] = "";
+static uint32_t temp_serial = 0;
+
+// MARK: - HELPERS
+
+static uint64_t align8(uint64_t value) {
+    return (value + 7) & ~(uint64_t)7;
+}
+
+void gpmf_cache_set_directory(const char* directory) {
+    if (!directory) {
+        cache_directory[0] = '\0';
+        return;
+    }
+    strncpy(cache_directory, directory, sizeof(cache_directory) - 1);
+    cache_directory[sizeof(cache_directory) - 1] = '\0';
+}
+
+// Resolve o caminho absoluto e os dados de validade do arquivo de origem
+static int resolve_source(const char* file_path, char* full_path, struct stat* st) {
+    if (!file_path || cache_directory[0] == '\0') return 0;
+    if (!realpath(file_path, full_path)) return 0;
+    return stat(full_path, st) == 0;
+}
+
+// Nanossegundos do mtime: uma regravação do mesmo tamanho no mesmo segundo também invalida
+static uint32_t mtime_nsec(const struct stat* st) {
+#ifdef __APPLE__
+    return (uint32_t)st->st_mtimespec.tv_nsec;
+#else
+    return (uint32_t)st->st_mtim.tv_nsec;
+#endif
+}
+
+static void cache_file_path(const char* full_path, const char* variant, char* out, size_t out_size) {
+    uint64_t hash = 14695981039346656037ULL; // FNV-1a sobre caminho + variante
+    for (const char* c = full_path; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+    hash ^= '|';
+    hash *= 1099511628211ULL;
+    for (const char* c = variant; *c; c++) {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(out, out_size, "%s/%016llx.gpmfcols", cache_directory, (unsigned long long)hash);
+}
+
+// MARK: - LEITURA
+
+C_GPMFColumnSet* gpmf_cache_load(const char* file_path, const char* variant, char* device_name) {
+    char full_path[PATH_MAX];
+    char cache_path[PATH_MAX + 64];
+    struct stat source;
+
+    if (!variant) variant = "";
+    if (!resolve_source(file_path, full_path, &source)) return NULL;
+    cache_file_path(full_path, variant, cache_path, sizeof(cache_path));
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (uint64_t)st.st_size < sizeof(DecodedCacheHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t map_size = (size_t)st.st_size;
+    uint8_t* map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+
+    const DecodedCacheHeader* header = (const DecodedCacheHeader*)map;
+    size_t path_length = strlen(full_path);
+    size_t variant_length = strlen(variant);
+    uint64_t names_end = sizeof(DecodedCacheHeader) + (uint64_t)header->path_length + header->variant_length;
+    uint64_t table_offset = align8(names_end);
+
+    int valid = header->magic == DECODED_CACHE_MAGIC &&
+                header->version == DECODED_CACHE_VERSION &&
+                header->total_size == (uint64_t)map_size &&
+                header->source_size == (uint64_t)source.st_size &&
+                header->source_mtime == (int64_t)source.st_mtime &&
+                header->source_mtime_nsec == mtime_nsec(&source) &&
+                header->path_length == path_length &&
+                header->variant_length == variant_length &&
+                header->stream_count > 0 &&
+                table_offset + (uint64_t)header->stream_count * sizeof(DecodedCacheStream) <= map_size &&
+                memcmp(map + sizeof(DecodedCacheHeader), full_path, path_length) == 0 &&
+                memcmp(map + sizeof(DecodedCacheHeader) + path_length, variant, variant_length) == 0;
+
+    C_GPMFColumnSet* set = NULL;
+    C_GPMFColumnStream* streams = NULL;
+
+    if (valid) {
+        set = calloc(1, sizeof(C_GPMFColumnSet));
+        streams = calloc((size_t)header->stream_count, sizeof(C_GPMFColumnStream));
+        valid = set && streams;
+    }
+
+    const DecodedCacheStream* table = (const DecodedCacheStream*)(map + table_offset);
+    for (int32_t i = 0; valid && i < header->stream_count; i++) {
+        const DecodedCacheStream* entry = &table[i];
+        uint64_t count = (uint64_t)entry->sample_count;
+        uint64_t elements = (uint64_t)entry->elements_per_sample;
+
+        valid = entry->sample_count > 0 && entry->elements_per_sample > 0 && entry->elements_per_sample <= 64 &&
+                entry->timestamps_offset % 8 == 0 && entry->values_offset % 8 == 0 &&
+                entry->timestamps_offset + count * sizeof(double) <= map_size &&
+                entry->values_offset + count * elements * sizeof(double) <= map_size;
+        if (!valid) break;
+
+        C_GPMFColumnStream* cs = &streams[i];
+        memcpy(cs->type, entry->type, 4);
+        cs->type[4] = '\0';
+        cs->device_id = entry->device_id;
+        cs->timestamps = (double*)(map + entry->timestamps_offset);
+        cs->values = (double*)(map + entry->values_offset);
+        cs->sample_count = entry->sample_count;
+        cs->elements_per_sample = entry->elements_per_sample;
+        cs->sample_rate = entry->sample_rate;
+    }
+
+    if (!valid) {
+        free(set);
+        free(streams);
+        munmap(map, map_size);
+        return NULL;
+    }
+
+    if (device_name) {
+        memcpy(device_name, header->device_name, sizeof(header->device_name));
+        device_name[sizeof(header->device_name) - 1] = '\0';
+    }
+
+    set->streams = streams;
+    set->stream_count = header->stream_count;
+    set->storage = map;
+    return set;
+}
+
+void gpmf_cache_release(void* storage) {
+    if (!storage) return;
+    const DecodedCacheHeader* header = (const DecodedCacheHeader*)storage;
+    munmap(storage, (size_t)header->total_size);
+}
+
+// MARK: - ESCRITA
+
+static int write_padding(FILE* fp, uint64_t* offset) {
+    static const uint8_t zeros[8] = { 0 };
+    uint64_t padded = align8(*offset);
+    size_t pad = (size_t)(padded - *offset);
+    if (pad && fwrite(zeros, 1, pad, fp) != pad) return 0;
+    *offset = padded;
+    return 1;
+}
+
+void gpmf_cache_store(const char* file_path, const char* variant, const C_GPMFColumnSet* set, const char* device_name) {
+    char full_path[PATH_MAX];
+    char cache_path[PATH_MAX + 64];
+    char temp_path[PATH_MAX + 96];
+    struct stat source;
+
+    if (!set || set->stream_count <= 0) return;
+    if (!variant) variant = "";
+    if (!resolve_source(file_path, full_path, &source)) return;
+    cache_file_path(full_path, variant, cache_path, sizeof(cache_path));
+
+    DecodedCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = DECODED_CACHE_MAGIC;
+    header.version = DECODED_CACHE_VERSION;
+    header.source_size = (uint64_t)source.st_size;
+    header.source_mtime = (int64_t)source.st_mtime;
+    header.source_mtime_nsec = mtime_nsec(&source);
+    header.path_length = (uint32_t)strlen(full_path);
+    header.variant_length = (uint32_t)strlen(variant);
+    header.stream_count = set->stream_count;
+    if (device_name) strncpy(header.device_name, device_name, sizeof(header.device_name) - 1);
+
+    DecodedCacheStream* table = calloc((size_t)set->stream_count, sizeof(DecodedCacheStream));
+    if (!table) return;
+
+    // Offsets: tabela logo após os nomes, depois tempos e valores de cada stream
+    uint64_t table_offset = align8(sizeof(DecodedCacheHeader) + (uint64_t)header.path_length + header.variant_length);
+    uint64_t offset = table_offset + (uint64_t)set->stream_count * sizeof(DecodedCacheStream);
+
+    for (int32_t i = 0; i < set->stream_count; i++) {
+        const C_GPMFColumnStream* cs = &set->streams[i];
+        uint64_t count = (uint64_t)cs->sample_count;
+
+        memcpy(table[i].type, cs->type, 4);
+        table[i].device_id = cs->device_id;
+        table[i].sample_count = cs->sample_count;
+        table[i].elements_per_sample = cs->elements_per_sample;
+        table[i].sample_rate = cs->sample_rate;
+        table[i].timestamps_offset = align8(offset);
+        table[i].values_offset = table[i].timestamps_offset + count * sizeof(double);
+        offset = table[i].values_offset + count * (uint64_t)cs->elements_per_sample * sizeof(double);
+    }
+    header.total_size = offset;
+
+    // pid + serial: gravações simultâneas do mesmo cache (threads ou processos) não dividem o temporário
+    unsigned serial = __atomic_fetch_add(&temp_serial, 1, __ATOMIC_RELAXED);
+    snprintf(temp_path, sizeof(temp_path), "%s.%d.%u.tmp", cache_path, (int)getpid(), serial);
+    FILE* fp = fopen(temp_path, "wb");
+    if (!fp) {
+        free(table);
+        return;
+    }
+
+    uint64_t written = 0;
+    int ok = fwrite(&header, 1, sizeof(header), fp) == sizeof(header) &&
+             fwrite(full_path, 1, header.path_length, fp) == header.path_length &&
+             fwrite(variant, 1, header.variant_length, fp) == header.variant_length;
+    written = sizeof(header) + (uint64_t)header.path_length + header.variant_length;
+
+    ok = ok && write_padding(fp, &written) &&
+         fwrite(table, sizeof(DecodedCacheStream), (size_t)set->stream_count, fp) == (size_t)set->stream_count;
+    written += (uint64_t)set->stream_count * sizeof(DecodedCacheStream);
+
+    for (int32_t i = 0; ok && i < set->stream_count; i++) {
+        const C_GPMFColumnStream* cs = &set->streams[i];
+        size_t count = (size_t)cs->sample_count;
+        size_t values = count * (size_t)cs->elements_per_sample;
+
+        ok = write_padding(fp, &written) &&
+             fwrite(cs->timestamps, sizeof(double), count, fp) == count &&
+             fwrite(cs->values, sizeof(double), values, fp) == values;
+        written += (uint64_t)(count + values) * sizeof(double);
+    }
+
+    if (fclose(fp) != 0) ok = 0;
+    if (!ok || written != header.total_size || rename(temp_path, cache_path) != 0) {
+        remove(temp_path);
+    }
+    free(table);
+}
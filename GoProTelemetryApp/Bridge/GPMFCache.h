@@ -0,0 +1,26 @@
+//
+//  GPMFCache.h
+//  Cache binário da telemetria decodificada (uso interno do bridge)
+//
+
+#ifndef GPMFCache_h
+#define GPMFCache_h
+
+#include "GPMFBridge.h"
+
+// Diretório dos arquivos de cache (NULL ou "" desativa)
+void gpmf_cache_set_directory(const char* directory);
+
+// Mapeia o cache do arquivo, se existir e ainda for válido (mesmo caminho, tamanho e mtime).
+// 'variant' separa extrações diferentes do mesmo arquivo (ex: filtro de streams).
+// Os streams apontam para dentro do mapa: liberar com free_column_set.
+// 'device_name' (32 bytes) recebe o DVNM salvo junto.
+C_GPMFColumnSet* gpmf_cache_load(const char* file_path, const char* variant, char* device_name);
+
+// Grava o resultado de uma extração (arquivo temporário + rename)
+void gpmf_cache_store(const char* file_path, const char* variant, const C_GPMFColumnSet* set, const char* device_name);
+
+// Desfaz o mapa de um conjunto carregado do cache (C_GPMFColumnSet.storage)
+void gpmf_cache_release(void* storage);
+
+#endif /* GPMFCache_h */
@@ -0,0 +1,151 @@
+//
+//  GPMFTrace.c
+//  Spans da extração em formato Chrome trace
+//
+//  O arquivo usa o formato "JSON Array" (um evento por linha). O ']' final é
+//  opcional nesse formato, então cada extração só anexa linhas: chrome://tracing
+//  e ui.perfetto.dev abrem o arquivo mesmo com várias extrações acumuladas.
+//  Cada extração vira um processo (pid próprio, nomeado pelo MP4) e cada worker
+//  uma thread, então extrações paralelas não se misturam na timeline. O pid parte
+//  do pid real do processo, para que execuções anexadas ao mesmo arquivo também
+//  não colidam.
+//
+
+#include "GPMFTrace.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+static char trace_path[1024] = "";
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static int32_t trace_sequence = 0;
+
+// MARK: - CONFIGURAÇÃO
+
+void gpmf_trace_set_file(const char* path) {
+    pthread_mutex_lock(&trace_lock);
+    if (!path) {
+        trace_path[0] = '\0';
+    } else {
+        strncpy(trace_path, path, sizeof(trace_path) - 1);
+        trace_path[sizeof(trace_path) - 1] = '\0';
+    }
+    pthread_mutex_unlock(&trace_lock);
+}
+
+GPMFTrace* gpmf_trace_begin(void) {
+    if (trace_path[0] == '\0') return NULL;
+    GPMFTrace* trace = calloc(1, sizeof(GPMFTrace));
+    if (trace) trace->thread_count = 1;
+    return trace;
+}
+
+uint64_t gpmf_trace_clock(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// MARK: - SPANS
+
+void gpmf_trace_span(GPMFTraceBuffer* buffer, const char* name, uint64_t start, uint64_t end,
+                     int32_t payload, uint32_t fourcc, uint32_t bytes, uint32_t samples) {
+    if (!buffer) return;
+
+    if (buffer->count == buffer->capacity) {
+        uint32_t capacity = buffer->capacity ? buffer->capacity * 2 : 1024;
+        GPMFTraceSpan* grown = realloc(buffer->spans, (size_t)capacity * sizeof(GPMFTraceSpan));
+        if (!grown) return; // Sem memória: o span se perde, a extração segue
+        buffer->spans = grown;
+        buffer->capacity = capacity;
+    }
+
+    GPMFTraceSpan* span = &buffer->spans[buffer->count++];
+    span->name = name;
+    span->start = start;
+    span->end = end;
+    span->payload = payload;
+    span->fourcc = fourcc;
+    span->bytes = bytes;
+    span->samples = samples;
+}
+
+// MARK: - ESCRITA
+
+// Nome do arquivo (sem diretório) como string JSON
+static void write_json_name(FILE* f, const char* file_path) {
+    const char* name = file_path ? file_path : "";
+    const char* slash = strrchr(name, '/');
+    if (slash) name = slash + 1;
+
+    fputc('"', f);
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        if (*p == '"' || *p == '\\') fputc('\\', f);
+        if (*p < 0x20) continue;
+        fputc(*p, f);
+    }
+    fputc('"', f);
+}
+
+static void write_span(FILE* f, int32_t pid, int32_t tid, const GPMFTraceSpan* span) {
+    uint64_t duration = span->end > span->start ? span->end - span->start : 0;
+
+    // ts e dur em microssegundos
+    fprintf(f, "{\"name\":\"%s\",\"cat\":\"gpmf\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+            span->name, pid, tid, (double)span->start / 1000.0, (double)duration / 1000.0);
+
+    const char* separator = "";
+    if (span->payload >= 0) {
+        fprintf(f, "\"payload\":%d", span->payload);
+        separator = ",";
+    }
+    if (span->fourcc) {
+        char type[5];
+        memcpy(type, &span->fourcc, 4);
+        type[4] = '\0';
+        for (int i = 0; i < 4; i++) if (type[i] < 0x20 || type[i] == '"' || type[i] == '\\') type[i] = '?';
+        fprintf(f, "%s\"stream\":\"%s\"", separator, type);
+        separator = ",";
+    }
+    if (span->bytes) {
+        fprintf(f, "%s\"bytes\":%u", separator, span->bytes);
+        separator = ",";
+    }
+    if (span->samples) fprintf(f, "%s\"samples\":%u", separator, span->samples);
+    fputs("}},\n", f);
+}
+
+void gpmf_trace_end(GPMFTrace* trace, const char* file_path) {
+    if (!trace) return;
+
+    pthread_mutex_lock(&trace_lock);
+    FILE* f = trace_path[0] != '\0' ? fopen(trace_path, "a") : NULL;
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        if (ftell(f) == 0) fputs("[\n", f);
+
+        // Mil pids por execução (getpid() * 1000 + sequência), dentro de um int32
+        int32_t sequence = trace_sequence++ % 1000;
+        int32_t pid = (int32_t)(getpid() % 2000000) * 1000 + sequence + 1;
+        fprintf(f, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":", pid);
+        write_json_name(f, file_path);
+        fputs("}},\n", f);
+
+        for (int32_t t = 0; t < trace->thread_count && t < GPMF_TRACE_MAX_THREADS; t++) {
+            fprintf(f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}},\n",
+                    pid, t, t);
+
+            const GPMFTraceBuffer* buffer = &trace->threads[t];
+            for (uint32_t i = 0; i < buffer->count; i++) write_span(f, pid, t, &buffer->spans[i]);
+        }
+        fclose(f);
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    for (int32_t t = 0; t < GPMF_TRACE_MAX_THREADS; t++) free(trace->threads[t].spans);
+    free(trace);
+}
@@ -0,0 +1,53 @@
+//
+//  GPMFTrace.h
+//  Spans da extração em formato Chrome trace (uso interno do bridge)
+//
+
+#ifndef GPMFTrace_h
+#define GPMFTrace_h
+
+#include <stdint.h>
+
+#define GPMF_TRACE_MAX_THREADS 64
+
+// Um span completo ("ph":"X"). payload < 0 e fourcc 0 ficam fora dos args.
+typedef struct {
+    const char* name;      // Literal estático: "read", "decode", "scale"...
+    uint64_t start;        // ns, relógio monotônico
+    uint64_t end;
+    int32_t payload;
+    uint32_t fourcc;
+    uint32_t bytes;
+    uint32_t samples;
+} GPMFTraceSpan;
+
+// Spans de uma thread: só ela escreve, sem lock
+typedef struct {
+    GPMFTraceSpan* spans;
+    uint32_t count;
+    uint32_t capacity;
+} GPMFTraceBuffer;
+
+// Spans de uma extração. threads[0] é a thread que chamou (e o worker 0).
+typedef struct {
+    GPMFTraceBuffer threads[GPMF_TRACE_MAX_THREADS];
+    int32_t thread_count;
+} GPMFTrace;
+
+// Arquivo de trace (NULL ou "" desativa). Os spans de cada extração são anexados.
+void gpmf_trace_set_file(const char* path);
+
+// Nova extração rastreada, ou NULL quando o trace está desativado
+GPMFTrace* gpmf_trace_begin(void);
+
+// Relógio dos spans (ns)
+uint64_t gpmf_trace_clock(void);
+
+// Registra um span no buffer da thread (buffer NULL = sem trace)
+void gpmf_trace_span(GPMFTraceBuffer* buffer, const char* name, uint64_t start, uint64_t end,
+                     int32_t payload, uint32_t fourcc, uint32_t bytes, uint32_t samples);
+
+// Anexa os spans ao arquivo (um processo por extração, nomeado pelo MP4) e libera o trace
+void gpmf_trace_end(GPMFTrace* trace, const char* file_path);
+
+#endif /* GPMFTrace_h */
@@ -9,8 +9,10 @@
 /* ====================================================================
    IMPORTAÇÕES
    Permite que o Swift enxergue as funções e structs definidas em GPMFBridge.h
+   e GPMFAlign.h
    ==================================================================== */
 
 #include "GPMFBridge.h"
+#include "GPMFAlign.h"
 
 #endif /* GoProTelemetryApp_Bridging_Header_h */
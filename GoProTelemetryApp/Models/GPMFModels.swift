@@ -17,12 +17,51 @@ enum GPMFError: Error {
 }
 
 // MARK: - Raw Data Structures (DTOs)
+/// Stream em formato colunar: uma coluna de tempo e uma coluna por elemento (ex: GPS5 = 5 colunas).
 struct GPMFStream {
     let type: GPMFStreamType
-    let samples: [GPMFSample]
+    let deviceId: UInt32          // DVID de origem (câmera = 1; sensores externos têm outro)
+    let timestamps: GPMFColumn
+    let columns: [GPMFColumn]
     let sampleCount: Int
     let elementsPerSample: Int
     let sampleRate: Double
+    
+    /// Valores de um sample (uma posição de cada coluna)
+    func values(at index: Int) -> [Double] {
+        return columns.map { $0[index] }
+    }
+    
+    func sample(at index: Int) -> GPMFSample {
+        return GPMFSample(timestamp: timestamps[index], values: values(at: index))
+    }
+}
+
+/// Coluna de doubles emprestada da memória nativa (sem cópia). O `owner` mantém o buffer vivo
+/// enquanto houver alguma coluna apontando para ele.
+struct GPMFColumn: RandomAccessCollection {
+    private let buffer: UnsafeBufferPointer<Double>
+    private let owner: AnyObject
+    
+    init(buffer: UnsafeBufferPointer<Double>, owner: AnyObject) {
+        self.buffer = buffer
+        self.owner = owner
+    }
+    
+    var startIndex: Int { 0 }
+    var endIndex: Int { buffer.count }
+    
+    subscript(position: Int) -> Double {
+        return buffer[position]
+    }
+    
+    /// Início do buffer nativo. Só vale enquanto esta coluna (ou outra do mesmo dono) existir.
+    var baseAddress: UnsafePointer<Double>? { buffer.baseAddress }
+    
+    /// Acesso direto ao buffer contíguo (ex: vDSP), válido só dentro do closure
+    func withUnsafeBufferPointer<R>(_ body: (UnsafeBufferPointer<Double>) throws -> R) rethrows -> R {
+        return try withExtendedLifetime(owner) { try body(buffer) }
+    }
 }
 
 struct GPMFSample {
@@ -31,6 +31,8 @@ class GPMFTelemetryMapper {
         }
         
         // Mapa de acesso rápido (O(1)) para os streams
+        // Com vários dispositivos (DVID), o mesmo tipo aparece mais de uma vez: a câmera
+        // vem primeiro na extração, então ela é a fonte padrão de cada sensor
         let sensorMap = Dictionary(grouping: streams, by: { $0.type }).mapValues { $0.first! }
         
         // Processamento frame a frame
@@ -60,78 +62,118 @@ class GPMFTelemetryMapper {
         return priorityOrder.compactMap { type in streams.first(where: { $0.type == type }) }.first ?? streams.first
     }
     
+    /// Regras de alinhamento por sensor: modo e tolerância (segundos)
+    private static let alignmentRules: [(type: GPMFStreamType, mode: GPMFWrapper.AlignMode, tolerance: Double)] = [
+        // Alta frequência (IMU): valor exato do instante
+        (.accl, .nearest, 0.05), (.gyro, .nearest, 0.05), (.grav, .nearest, 0.05),
+        // Orientação (quaterniões)
+        (.cori, .nearest, 0.1), (.iori, .nearest, 0.1),
+        // GPS é lento (18Hz); o hold fica no Swift porque só vale para fix válido
+        (.gps9, .nearest, 0.2), (.gps5, .nearest, 0.2),
+        // Câmera e ambiente mudam pouco: mantém o último valor
+        (.iso, .hold, 1.0), (.shut, .hold, 1.0), (.wbal, .hold, 1.0),
+        (.temp, .hold, 2.0), (.scen, .hold, 2.0),
+        // Rostos não persistem
+        (.face, .nearest, 0.5),
+        (.wndm, .nearest, 0.05)
+    ]
+    
+    /// Colunas de um sensor já reamostradas na base do mestre (NaN = sem sample)
+    private struct AlignedSensor {
+        let elements: Int
+        let columns: [GPMFColumn]
+        
+        func has(_ index: Int) -> Bool {
+            return !columns.isEmpty && !columns[0][index].isNaN
+        }
+        
+        subscript(column: Int, index: Int) -> Double {
+            return columns[column][index]
+        }
+        
+        func values(at index: Int) -> [Double] {
+            return columns.map { $0[index] }
+        }
+    }
+    
     private static func processTimeline(master: GPMFStream, sensors: [GPMFStreamType: GPMFStream]) -> [TelemetryData] {
         var points: [TelemetryData] = []
-        points.reserveCapacity(master.samples.count)
+        points.reserveCapacity(master.sampleCount)
+        
+        // --- Alinhamento Nativo ---
+        // Todos os sensores são reamostrados nos tempos do mestre de uma vez (uma varredura por stream)
+        let rules = alignmentRules.filter { sensors[$0.type] != nil }
+        let requests = rules.map { GPMFWrapper.AlignRequest(stream: sensors[$0.type]!, mode: $0.mode, tolerance: $0.tolerance) }
+        let alignedColumns = GPMFWrapper.align(requests, to: master.timestamps)
+        
+        var aligned: [GPMFStreamType: AlignedSensor] = [:]
+        for (rule, columns) in zip(rules, alignedColumns) where !columns.isEmpty {
+            aligned[rule.type] = AlignedSensor(elements: columns.count, columns: columns)
+        }
+        
+        let accl = aligned[.accl]
+        let gyroSensor = aligned[.gyro]
+        let gravSensor = aligned[.grav]
+        let cori = aligned[.cori]
+        let iori = aligned[.iori]
+        let gps = aligned[.gps9] ?? aligned[.gps5]
+        let iso = aligned[.iso]
+        let shut = aligned[.shut]
+        let wbal = aligned[.wbal]
+        let temp = aligned[.temp]
+        let scen = aligned[.scen]
+        let face = aligned[.face]
+        let wndm = aligned[.wndm]
         
         // --- Estado Acumulado (Sample-and-Hold) ---
-        // Mantém o último valor conhecido para sensores que têm frequência menor que o mestre
+        // GPS só é mantido quando o fix é válido; os demais já vêm com hold do alinhamento
         var lastGPS: (lat: Double, lon: Double, alt: Double, s2d: Double, s3d: Double)?
-        var lastISO: Double?
-        var lastShutter: Double?
-        var lastWBAL: Double?
-        var lastTemp: Double?
+        var lastSceneCode: Double = .nan
         var lastScene: String?
-        var lastFaces: [DetectedFace]?
         
         var totalDistance: Double = 0.0
         var previousCoord: CLLocationCoordinate2D?
         
-        // Índices para busca otimizada (evita varrer arrays do zero)
-        var indices: [GPMFStreamType: Int] = [:]
-        
-        for sample in master.samples {
-            let time = sample.timestamp
+        for masterIndex in 0..<master.sampleCount {
+            let time = master.timestamps[masterIndex]
             
             // 1. Alta Frequência (IMU - Dinâmica)
-            // Estes mudam muito rápido, tentamos pegar o valor exato
             
             var accel: Vector3?
-            if let stream = sensors[.accl], let vals = findNearest(time: time, stream: stream, indices: &indices) {
-                accel = Vector3(x: vals[0], y: vals[1], z: vals[2])
-            } else if master.type == .accl {
-                accel = Vector3(x: sample.values[0], y: sample.values[1], z: sample.values[2])
+            if let s = accl, s.elements >= 3, s.has(masterIndex) {
+                accel = Vector3(x: s[0, masterIndex], y: s[1, masterIndex], z: s[2, masterIndex])
+            } else if master.type == .accl, master.elementsPerSample >= 3 {
+                accel = Vector3(x: master.columns[0][masterIndex], y: master.columns[1][masterIndex], z: master.columns[2][masterIndex])
             }
             
             var gyro: Vector3?
-            if let stream = sensors[.gyro], let vals = findNearest(time: time, stream: stream, indices: &indices) {
-                gyro = Vector3(x: vals[0], y: vals[1], z: vals[2])
+            if let s = gyroSensor, s.elements >= 3, s.has(masterIndex) {
+                gyro = Vector3(x: s[0, masterIndex], y: s[1, masterIndex], z: s[2, masterIndex])
             }
             
             var gravity: Vector3?
-            if let stream = sensors[.grav], let vals = findNearest(time: time, stream: stream, indices: &indices) {
-                gravity = Vector3(x: vals[0], y: vals[1], z: vals[2])
+            if let s = gravSensor, s.elements >= 3, s.has(masterIndex) {
+                gravity = Vector3(x: s[0, masterIndex], y: s[1, masterIndex], z: s[2, masterIndex])
             }
             
             // 2. Orientação (Quaterniões)
             // CORI: Camera Orientation / IORI: Image Orientation
             var camOrient: Vector4?
-            if let stream = sensors[.cori], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 0.1) {
-                if vals.count >= 4 {
-                    camOrient = Vector4(w: vals[0], x: vals[1], y: vals[2], z: vals[3])
-                }
+            if let s = cori, s.elements >= 4, s.has(masterIndex) {
+                camOrient = Vector4(w: s[0, masterIndex], x: s[1, masterIndex], y: s[2, masterIndex], z: s[3, masterIndex])
             }
             
             var imgOrient: Vector4?
-            if let stream = sensors[.iori], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 0.1) {
-                if vals.count >= 4 {
-                    imgOrient = Vector4(w: vals[0], x: vals[1], y: vals[2], z: vals[3])
-                }
+            if let s = iori, s.elements >= 4, s.has(masterIndex) {
+                imgOrient = Vector4(w: s[0, masterIndex], x: s[1, masterIndex], y: s[2, masterIndex], z: s[3, masterIndex])
             }
             
             // 3. GPS (Navegação)
-            // Tolerância maior (0.2s) pois GPS é lento (18Hz)
-            var currentGPS = lastGPS
-            let gpsStream = sensors[.gps9] ?? sensors[.gps5]
-            if let stream = gpsStream, let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 0.2) {
-                if let parsed = parseGPS(vals, type: stream.type), abs(parsed.lat) > 0.001 {
-                    currentGPS = parsed
-                    lastGPS = parsed
-                }
-            } else {
-                // Se não achou ponto próximo, mantém o lastGPS (Sample-and-Hold)
-                // ou define nil se quiser mostrar "Sem sinal" na UI
+            // Sem ponto próximo (ou fix inválido) mantém o lastGPS (Sample-and-Hold)
+            if let s = gps, s.elements >= 5, s.has(masterIndex), abs(s[0, masterIndex]) > 0.001 {
+                lastGPS = (s[0, masterIndex], s[1, masterIndex], s[2, masterIndex], s[3, masterIndex], s[4, masterIndex])
             }
+            let currentGPS = lastGPS
             
             // Cálculo de Distância Acumulada
             if let gps = currentGPS {
@@ -144,46 +186,31 @@ class GPMFTelemetryMapper {
                 previousCoord = coord
             }
             
-            // 4. Dados de Câmera (Lentos / Metadados)
-            // Tolerância de 1.0s é aceitável, pois mudam pouco
-            
-            if let stream = sensors[.iso], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 1.0) {
-                lastISO = vals[0]
-            }
-            
-            if let stream = sensors[.shut], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 1.0) {
-                lastShutter = vals[0]
-            }
-            
-            if let stream = sensors[.wbal], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 1.0) {
-                lastWBAL = vals[0]
-            }
-            
-            // Temperatura
-            if let stream = sensors[.temp], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 2.0) {
-                lastTemp = vals[0]
-            }
+            // 4. Dados de Câmera (Lentos / Metadados) e Temperatura
+            // Modo hold: NaN só antes do primeiro valor
+            let lastISO = iso.flatMap { $0.has(masterIndex) ? $0[0, masterIndex] : nil }
+            let lastShutter = shut.flatMap { $0.has(masterIndex) ? $0[0, masterIndex] : nil }
+            let lastWBAL = wbal.flatMap { $0.has(masterIndex) ? $0[0, masterIndex] : nil }
+            let lastTemp = temp.flatMap { $0.has(masterIndex) ? $0[0, masterIndex] : nil }
             
             // 5. Inteligência (Cena e Rosto)
             
-            // Cenas (SCEN): Decodificar FourCC do Double
-            if let stream = sensors[.scen], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 2.0) {
-                lastScene = decodeFourCC(vals[0])
+            // Cenas (SCEN): Decodificar FourCC do Double (só quando muda)
+            if let s = scen, s.has(masterIndex), s[0, masterIndex] != lastSceneCode {
+                lastSceneCode = s[0, masterIndex]
+                lastScene = decodeFourCC(lastSceneCode)
             }
             
-            // Rostos (FACE)
-            if let stream = sensors[.face], let vals = findNearest(time: time, stream: stream, indices: &indices, tolerance: 0.5) {
-                if vals.count >= 4 {
-                    lastFaces = parseFaces(vals, elements: stream.elementsPerSample)
-                }
-            } else {
-                lastFaces = nil // Rostos não persistem
+            // Rostos (FACE): não persistem
+            var lastFaces: [DetectedFace]?
+            if let s = face, s.elements >= 4, s.has(masterIndex) {
+                lastFaces = parseFaces(s.values(at: masterIndex), elements: s.elements)
             }
             
             // 6. Áudio (Vento)
             var audioDiag: AudioDiagnostic?
-            if let stream = sensors[.wndm], let vals = findNearest(time: time, stream: stream, indices: &indices) {
-                let level = vals.count > 1 ? vals[1] : vals[0]
+            if let s = wndm, s.has(masterIndex) {
+                let level = s.elements > 1 ? s[1, masterIndex] : s[0, masterIndex]
                 audioDiag = AudioDiagnostic(windNoiseLevel: level > 1 ? level/100.0 : level, isWet: false)
             }
             
@@ -297,40 +324,6 @@ class GPMFTelemetryMapper {
         }
         return faces
     }
-    
-    // Algoritmo de busca rápida com cursor persistente (indices)
-    private static func findNearest(time: Double, stream: GPMFStream, indices: inout [GPMFStreamType: Int], tolerance: Double = 0.05) -> [Double]? {
-        let startIndex = indices[stream.type] ?? 0
-        let samples = stream.samples
-        guard startIndex < samples.count else { return nil }
-        
-        var bestIndex = startIndex
-        var minDiff = abs(samples[startIndex].timestamp - time)
-        
-        // Olha para frente até 500 samples (otimização)
-        let maxSearch = min(startIndex + 500, samples.count)
-        for i in startIndex..<maxSearch {
-            let diff = abs(samples[i].timestamp - time)
-            if diff < minDiff {
-                minDiff = diff
-                bestIndex = i
-            } else if diff > minDiff {
-                // Se a diferença começou a aumentar, passamos do ponto ideal (lista ordenada por tempo)
-                break
-            }
-        }
-        
-        // Atualiza o cursor para a próxima iteração começar daqui
-        indices[stream.type] = bestIndex
-        
-        if minDiff > tolerance { return nil }
-        return samples[bestIndex].values
-    }
-    
-    private static func parseGPS(_ values: [Double], type: GPMFStreamType) -> (lat: Double, lon: Double, alt: Double, s2d: Double, s3d: Double)? {
-        guard values.count >= 5 else { return nil }
-        return (values[0], values[1], values[2], values[3], values[4])
-    }
 }
 
 // MARK: - Extensions
@@ -10,76 +10,210 @@ import Foundation
 /// Wrapper responsável por invocar o parser C e converter os resultados para estruturas Swift seguras.
 class GPMFWrapper {
     
+    // MARK: - Native Cache
+    
+    /// Diretório de cache do parser C (índices de payload por arquivo). Configurado uma única vez.
+    private static let nativeCacheSetup: Void = {
+        let fileManager = FileManager.default
+        let base = fileManager.urls(for: .cachesDirectory, in: .userDomainMask).first ?? fileManager.temporaryDirectory
+        let directory = base.appendingPathComponent("GPMFCache", isDirectory: true)
+        try? fileManager.createDirectory(at: directory, withIntermediateDirectories: true)
+        gpmf_set_cache_directory(directory.path)
+        
+        // Trace das extrações (Chrome trace JSON) quando GPMF_TRACE_FILE está definido
+        if let tracePath = ProcessInfo.processInfo.environment["GPMF_TRACE_FILE"], !tracePath.isEmpty {
+            gpmf_set_trace_file(tracePath)
+        }
+    }()
+    
     // MARK: - Public API
     
     /// Processa um arquivo de vídeo e retorna os streams e metadados.
-    /// - Parameter url: URL local do arquivo de vídeo.
+    /// - Parameters:
+    ///   - url: URL local do arquivo de vídeo.
+    ///   - types: Streams a extrair (ex: só GPS para exportar GPX). `nil` extrai todos.
+    ///   - timeRange: Intervalo em segundos (ex: trecho de um clipe). Só os payloads que cruzam o
+    ///     intervalo são lidos e os samples vêm recortados nele. `nil` extrai o arquivo inteiro.
     /// - Returns: Tupla contendo os streams de dados e o nome da câmera (se encontrado).
-    static func parse(url: URL) throws -> (streams: [GPMFStream], deviceName: String?) {
+    static func parse(url: URL, only types: Set<GPMFStreamType>? = nil, timeRange: ClosedRange<Double>? = nil) throws -> (streams: [GPMFStream], deviceName: String?) {
+        return try parse(chapters: [url], only: types, timeRange: timeRange)
+    }
+    
+    /// Processa uma gravação dividida em capítulos (GX01xxxx.MP4, GX02xxxx.MP4, ...) como uma única
+    /// timeline: o C concatena os payloads e desloca os tempos de cada capítulo, sem costura no Swift.
+    /// - Parameters:
+    ///   - urls: Capítulos na ordem da gravação. Um único arquivo equivale a `parse(url:)`.
+    ///   - types: Streams a extrair. `nil` extrai todos.
+    ///   - timeRange: Intervalo em segundos na timeline da gravação inteira. `nil` extrai tudo.
+    /// - Returns: Tupla contendo os streams de dados e o nome da câmera (se encontrado).
+    static func parse(chapters urls: [URL], only types: Set<GPMFStreamType>? = nil, timeRange: ClosedRange<Double>? = nil) throws -> (streams: [GPMFStream], deviceName: String?) {
         // 1. Validação de Acesso
-        guard FileManager.default.fileExists(atPath: url.path) else {
+        guard let firstURL = urls.first else {
+            throw GPMFError.invalidData
+        }
+        
+        for url in urls where !FileManager.default.fileExists(atPath: url.path) {
             throw GPMFError.fileAccessDenied
         }
         
-        guard let cFilePath = (url.path as NSString).utf8String else {
+        _ = nativeCacheSetup
+        
+        print("🔌 GPMFWrapper: Iniciando extração nativa de \(firstURL.lastPathComponent)" + (urls.count > 1 ? " (+\(urls.count - 1) capítulos)" : ""))
+        
+        // 2. Sessão: cada MP4 é aberto (e indexado) uma única vez
+        let cPaths = urls.map { strdup($0.path) }
+        defer { cPaths.forEach { free($0) } }
+        guard !cPaths.contains(where: { $0 == nil }) else {
             throw GPMFError.invalidData
         }
         
-        print("🔌 GPMFWrapper: Iniciando extração nativa de \(url.lastPathComponent)")
+        let openedSession: OpaquePointer? = cPaths.withUnsafeBufferPointer { buffer in
+            buffer.baseAddress!.withMemoryRebound(to: UnsafePointer<CChar>?.self, capacity: buffer.count) {
+                gpmf_session_open_chapters($0, Int32(buffer.count))
+            }
+        }
+        guard let session = openedSession else {
+            print("⚠️ GPMFWrapper: arquivo sem trilha GPMF")
+            // Retorna vazio mas com sucesso, pois pode ser um vídeo sem telemetria mas válido
+            return ([], nil)
+        }
+        defer { gpmf_session_close(session) }
         
-        // 2. Extrair Nome do Dispositivo (Nova Função C)
-        var deviceName: String? = nil
-        if let cDeviceName = get_device_name(cFilePath) {
-            deviceName = String(cString: cDeviceName)
-            free(cDeviceName) // Importante: Liberar a string alocada no C
+        // 3. Extrair Streams de Telemetria (formato colunar)
+        // O filtro é aplicado no C: streams fora da lista nem são convertidos
+        let filter = types?.map(\.rawValue).sorted().joined(separator: ",")
+        let cSet: UnsafeMutablePointer<C_GPMFColumnSet>? = withOptionalCString(filter) { cFilter in
+            var options = C_GPMFParseOptions()
+            options.fourcc_filter = cFilter
+            if let range = timeRange {
+                return gpmf_session_parse_range(session, range.lowerBound, range.upperBound, &options)
+            }
+            return gpmf_session_parse_columns(session, &options)
         }
         
-        // 3. Extrair Streams de Telemetria
-        guard let cStreamsPtr = parse_gpmf_from_file(cFilePath) else {
-            print("⚠️ GPMFWrapper: parse_gpmf_from_file retornou NULL")
-            // Retorna vazio mas com sucesso, pois pode ser um vídeo sem telemetria mas válido
+        // Nome do Dispositivo: já capturado na passada principal (string pertence à sessão)
+        let deviceName = gpmf_session_device_name(session).map { String(cString: $0) }
+        
+        guard let cSetPtr = cSet else {
+            print("⚠️ GPMFWrapper: gpmf_session_parse_columns retornou NULL")
             return ([], deviceName)
         }
         
         // 4. Gestão de Memória
-        defer {
-            free_parsed_streams(cStreamsPtr)
-        }
+        // O conjunto passa a pertencer ao NativeColumnSet: as colunas Swift apontam direto para
+        // ele e o free_column_set acontece quando o último stream for liberado
+        let owner = NativeColumnSet(cSetPtr)
         
-        // 5. Conversão para Swift
-        let streams = convertToSwift(cStreamsPtr: cStreamsPtr)
+        // 5. Conversão para Swift (sem cópia dos samples)
+        let streams = convertToSwift(owner: owner)
         print("🔌 GPMFWrapper: Sucesso. \(streams.count) streams de \(deviceName ?? "Câmera Desconhecida").")
         
         return (streams, deviceName)
     }
     
+    /// Leitura incremental: entrega cada bloco (um stream de um payload) assim que é decodificado,
+    /// na ordem do arquivo. A memória nativa usada é a de um único payload.
+    /// - Parameters:
+    ///   - url: URL local do arquivo de vídeo.
+    ///   - onBlock: Recebe o bloco e o progresso (0...1). Retornar `false` cancela a leitura.
+    /// - Returns: Quantidade de payloads lidos.
+    @discardableResult
+    static func parseIncrementally(url: URL, onBlock: @escaping (GPMFStream, Double) -> Bool) throws -> Int {
+        guard FileManager.default.fileExists(atPath: url.path) else {
+            throw GPMFError.fileAccessDenied
+        }
+        
+        guard let cFilePath = (url.path as NSString).utf8String else {
+            throw GPMFError.invalidData
+        }
+        
+        _ = nativeCacheSetup
+        
+        // O callback C não captura contexto: o handler viaja como ponteiro opaco
+        let box = BlockHandlerBox(onBlock)
+        let context = Unmanaged.passUnretained(box).toOpaque()
+        
+        let processed = withExtendedLifetime(box) {
+            parse_gpmf_blocks_from_file(cFilePath, { blockPtr, context in
+                guard let blockPtr = blockPtr, let context = context else { return 0 }
+                let box = Unmanaged<BlockHandlerBox>.fromOpaque(context).takeUnretainedValue()
+                let block = blockPtr.pointee
+                
+                guard let stream = GPMFWrapper.convertBlock(block) else { return 1 }
+                let progress = block.payload_count > 0 ? Double(block.payload_index + 1) / Double(block.payload_count) : 1.0
+                return box.handler(stream, progress) ? 1 : 0
+            }, context)
+        }
+        
+        guard processed >= 0 else { throw GPMFError.parsingFailed }
+        return Int(processed)
+    }
+    
+    /// Modo de leitura de um stream no alinhamento (mesmos valores de C_GPMFAlignMode).
+    enum AlignMode: Int32 {
+        case nearest = 0  // Sample mais próximo dentro da tolerância
+        case linear = 1   // Interpolação entre vizinhos
+        case hold = 2     // Mais próximo, ou o último valor quando não há sample
+    }
+    
+    struct AlignRequest {
+        let stream: GPMFStream
+        let mode: AlignMode
+        let tolerance: Double   // Segundos
+    }
+    
+    /// Reamostra os streams nos tempos `times` numa única varredura nativa por stream.
+    /// - Returns: Para cada pedido (mesma ordem), uma coluna por elemento com `times.count`
+    ///   posições. NaN marca os instantes sem sample dentro da tolerância.
+    static func align(_ requests: [AlignRequest], to times: GPMFColumn) -> [[GPMFColumn]] {
+        let channels = requests.map { request -> C_GPMFAlignChannel in
+            let stream = request.stream
+            var channel = C_GPMFAlignChannel()
+            // Colunas de um stream são fatias consecutivas de um único bloco
+            channel.timestamps = stream.timestamps.baseAddress
+            channel.values = stream.columns.first?.baseAddress
+            channel.sample_count = Int32(stream.sampleCount)
+            channel.elements_per_sample = Int32(stream.elementsPerSample)
+            channel.mode = request.mode.rawValue
+            channel.tolerance = request.tolerance
+            return channel
+        }
+        
+        let aligned = withExtendedLifetime((requests, times)) {
+            gpmf_align_streams(times.baseAddress, Int32(times.count), channels, Int32(channels.count))
+        }
+        guard let alignedPtr = aligned else { return requests.map { _ in [] } }
+        
+        let owner = NativeAlignedSet(alignedPtr)
+        let count = Int(alignedPtr.pointee.sample_count)
+        let outStreams = UnsafeBufferPointer(start: alignedPtr.pointee.streams, count: Int(alignedPtr.pointee.stream_count))
+        
+        return outStreams.map { out in
+            guard let valuesPtr = out.values else { return [] }
+            return (0..<Int(out.elements_per_sample)).map { column in
+                GPMFColumn(buffer: UnsafeBufferPointer(start: valuesPtr + column * count, count: count), owner: owner)
+            }
+        }
+    }
+    
     /// Verifica rapidamente se o arquivo possui trilha GPMF válida.
     static func hasTelemetry(url: URL) -> Bool {
         guard let cFilePath = (url.path as NSString).utf8String else { return false }
+        _ = nativeCacheSetup
         return has_gpmf_stream(cFilePath) != 0
     }
     
     // MARK: - Private Conversion Helpers
     
-    private static func convertToSwift(cStreamsPtr: UnsafeMutablePointer<C_GPMFStream>) -> [GPMFStream] {
-        var swiftStreams: [GPMFStream] = []
-        var currentPtr = cStreamsPtr
-        
-        // Itera sobre a lista encadeada C
-        while currentPtr.pointee.type.0 != 0 {
-            let cStream = currentPtr.pointee
-            
-            if let stream = convertSingleStream(cStream) {
-                swiftStreams.append(stream)
-            }
-            
-            currentPtr = currentPtr.advanced(by: 1)
-        }
+    private static func convertToSwift(owner: NativeColumnSet) -> [GPMFStream] {
+        let set = owner.pointer.pointee
+        guard let cStreams = set.streams, set.stream_count > 0 else { return [] }
         
-        return swiftStreams
+        let buffer = UnsafeBufferPointer(start: cStreams, count: Int(set.stream_count))
+        return buffer.compactMap { convertSingleStream($0, owner: owner) }
     }
     
-    private static func convertSingleStream(_ cStream: C_GPMFStream) -> GPMFStream? {
+    private static func convertSingleStream(_ cStream: C_GPMFColumnStream, owner: NativeColumnSet) -> GPMFStream? {
         // 1. Converter Tipo (FourCC -> Enum)
         let typeStr = fourCCString(from: cStream.type)
         let type = GPMFStreamType.from(fourCC: typeStr)
@@ -88,54 +222,105 @@ class GPMFWrapper {
         // Aqui mantemos para garantir que dados novos (como WNDM) passem.
         
         let count = Int(cStream.sample_count)
-        guard count > 0, let samplesPtr = cStream.samples else { return nil }
+        guard count > 0, let timesPtr = cStream.timestamps, let valuesPtr = cStream.values else { return nil }
         
         let elements = Int(cStream.elements_per_sample)
         
-        // 2. Converter Amostras
-        // Otimização: reserveCapacity evita realocações múltiplas
-        var swiftSamples: [GPMFSample] = []
-        swiftSamples.reserveCapacity(count)
-        
-        for i in 0..<count {
-            let cSample = samplesPtr[i]
-            
-            // Converte a tupla C fixa para Array Swift dinâmico
-            let values = tupleToArray(cSample.values, validCount: elements)
-            
-            swiftSamples.append(GPMFSample(
-                timestamp: cSample.timestamp,
-                values: values
-            ))
+        // 2. Emprestar Colunas
+        // Cada coluna é um bloco contíguo no C e continua lá até o conjunto ser liberado
+        let timestamps = GPMFColumn(buffer: UnsafeBufferPointer(start: timesPtr, count: count), owner: owner)
+        let columns = (0..<elements).map { column in
+            GPMFColumn(buffer: UnsafeBufferPointer(start: valuesPtr + column * count, count: count), owner: owner)
         }
         
         return GPMFStream(
             type: type,
-            samples: swiftSamples,
+            deviceId: cStream.device_id,
+            timestamps: timestamps,
+            columns: columns,
             sampleCount: count,
             elementsPerSample: elements,
             sampleRate: cStream.sample_rate
         )
     }
     
+    private static func convertBlock(_ block: C_GPMFSampleBlock) -> GPMFStream? {
+        let count = Int(block.sample_count)
+        guard count > 0, let timesPtr = block.timestamps, let valuesPtr = block.values else { return nil }
+        
+        let elements = Int(block.elements_per_sample)
+        
+        // Os ponteiros só valem durante o callback: copia o bloco inteiro de uma vez
+        let storage = CopiedColumns(timestamps: timesPtr, values: valuesPtr, count: count, elements: elements)
+        let timestamps = GPMFColumn(buffer: UnsafeBufferPointer(storage.timestamps), owner: storage)
+        let columns = (0..<elements).map { column in
+            GPMFColumn(buffer: UnsafeBufferPointer(rebasing: storage.values[(column * count)..<((column + 1) * count)]), owner: storage)
+        }
+        
+        // Taxa local do bloco (a extração completa mede a taxa do arquivo inteiro)
+        let span = count > 1 ? timestamps[count - 1] - timestamps[0] : 0
+        
+        return GPMFStream(
+            type: GPMFStreamType.from(fourCC: fourCCString(from: block.type)),
+            deviceId: block.device_id,
+            timestamps: timestamps,
+            columns: columns,
+            sampleCount: count,
+            elementsPerSample: elements,
+            sampleRate: span > 0 ? Double(count - 1) / span : 0
+        )
+    }
+    
+    /// Dono de um C_GPMFColumnSet: segura uma referência nativa e a devolve no deinit.
+    private final class NativeColumnSet {
+        let pointer: UnsafeMutablePointer<C_GPMFColumnSet>
+        init(_ pointer: UnsafeMutablePointer<C_GPMFColumnSet>) { self.pointer = pointer }
+        deinit { free_column_set(pointer) }
+    }
+    
+    /// Dono de um C_GPMFAlignedSet (colunas reamostradas).
+    private final class NativeAlignedSet {
+        let pointer: UnsafeMutablePointer<C_GPMFAlignedSet>
+        init(_ pointer: UnsafeMutablePointer<C_GPMFAlignedSet>) { self.pointer = pointer }
+        deinit { free_aligned_set(pointer) }
+    }
+    
+    /// Cópia própria de um bloco incremental (os ponteiros do C morrem com o callback).
+    private final class CopiedColumns {
+        let timestamps: UnsafeMutableBufferPointer<Double>
+        let values: UnsafeMutableBufferPointer<Double>
+        
+        init(timestamps: UnsafePointer<Double>, values: UnsafePointer<Double>, count: Int, elements: Int) {
+            self.timestamps = .allocate(capacity: count)
+            self.timestamps.baseAddress!.initialize(from: timestamps, count: count)
+            self.values = .allocate(capacity: count * elements)
+            self.values.baseAddress?.initialize(from: values, count: count * elements)
+        }
+        
+        deinit {
+            timestamps.deallocate()
+            values.deallocate()
+        }
+    }
+    
+    /// Caixa para passar o handler Swift pelo `void* context` do callback C.
+    private final class BlockHandlerBox {
+        let handler: (GPMFStream, Double) -> Bool
+        init(_ handler: @escaping (GPMFStream, Double) -> Bool) { self.handler = handler }
+    }
+    
     // MARK: - Low Level Utils
     
+    /// Executa `body` com o ponteiro C da string (ou NULL quando não há string)
+    private static func withOptionalCString<T>(_ string: String?, _ body: (UnsafePointer<CChar>?) -> T) -> T {
+        guard let string = string else { return body(nil) }
+        return string.withCString { body($0) }
+    }
+    
     /// Converte a tupla de caracteres C para String Swift
     private static func fourCCString(from tuple: (CChar, CChar, CChar, CChar, CChar)) -> String {
         let bytes = [tuple.0, tuple.1, tuple.2, tuple.3]
         let validBytes = bytes.map { UInt8(bitPattern: $0) }.filter { $0 != 0 }
         return String(bytes: validBytes, encoding: .ascii) ?? "UNKN"
     }
-    
-    /// Converte buffer de memória C (tuple double[16]) para [Double]
-    private static func tupleToArray(_ tuple: (Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double, Double), validCount: Int) -> [Double] {
-        var t = tuple
-        return withUnsafePointer(to: &t) { ptr in
-            ptr.withMemoryRebound(to: Double.self, capacity: 16) { doublePtr in
-                let safeCount = min(validCount, 16)
-                // Cria array copiando os valores
-                return Array(UnsafeBufferPointer(start: doublePtr, count: safeCount))
-            }
-        }
-    }
 }
@@ -28,10 +28,53 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#ifdef _WINDOWS
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+#endif
+
 #include "GPMF_mp4reader.h"
 
 #define PRINT_MP4_STRUCTURE		0
 
+
+/* Monotonic nanoseconds for the open time and the mp4counters read timer. */
+static uint64_t MP4Clock(void)
+{
+#ifdef _WINDOWS
+	LARGE_INTEGER count, frequency;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+
+void SetMP4Counters(size_t mp4handle, mp4counters *counters)
+{
+	mp4object *mp4 = (mp4object *)mp4handle;
+
+	if (mp4)
+	{
+		mp4->counters = counters;
+		if (counters)
+		{
+			counters->atoms = mp4->atoms;
+			counters->open_ns = mp4->open_ns;
+		}
+	}
+}
+
 #ifdef _WINDOWS
 #define LONGTELL	_ftelli64
 #else
@@ -69,6 +112,10 @@ size_t GetPayloadResource(size_t mp4handle, size_t resHandle, uint32_t payloadsi
 	if(res)
 	{
 		uint32_t myBufferSize = payloadsize + 256;
+		mp4object *mp4 = (mp4object *)mp4handle;
+
+		if (mp4 && mp4->counters && (res->buffer == NULL || payloadsize > res->bufferSize))
+			mp4->counters->allocations++;
 
 		if (res->buffer == NULL)
 		{
@@ -112,18 +159,33 @@ void FreePayloadResource(size_t mp4handle, size_t resHandle)
 }
 
 
-uint32_t *GetPayload(size_t mp4handle, size_t resHandle, uint32_t index)
+static uint32_t *ReadPayload(mp4object *mp4, size_t resHandle, uint32_t index)
 {
-	mp4object *mp4 = (mp4object *)mp4handle;
+	size_t mp4handle = (size_t)mp4;
 	resObject *res = (resObject *)resHandle;
 
-	if (mp4 == NULL) return NULL;
 	if (res == NULL) return NULL;
 
 	if (index < mp4->indexcount && mp4->mediafp)
 	{
 		if ((mp4->filesize >= mp4->metaoffsets[index]+mp4->metasizes[index]) && (mp4->metasizes[index] > 0))
 		{
+			if (mp4->mediamap)
+			{
+				uint8_t *src = mp4->mediamap + mp4->metaoffsets[index];
+
+				if (((size_t)src & 3) == 0) // GPMF is read as 32-bit words, so only aligned payloads are returned in place
+					return (uint32_t *)src;
+
+				resHandle = GetPayloadResource(mp4handle, resHandle, mp4->metasizes[index]);
+				if (resHandle)
+				{
+					memcpy(res->buffer, src, mp4->metasizes[index]);
+					return res->buffer;
+				}
+				return NULL;
+			}
+
 			uint32_t buffsizeneeded = mp4->metasizes[index];  // Add a little more to limit reallocations
 
 			resHandle = GetPayloadResource(mp4handle, resHandle, buffsizeneeded);
@@ -145,6 +207,33 @@ uint32_t *GetPayload(size_t mp4handle, size_t resHandle, uint32_t index)
 }
 
 
+uint32_t *GetPayload(size_t mp4handle, size_t resHandle, uint32_t index)
+{
+	mp4object *mp4 = (mp4object *)mp4handle;
+	mp4counters *counters;
+	uint64_t start;
+	uint32_t *payload;
+
+	if (mp4 == NULL) return NULL;
+	if (mp4->counters == NULL) return ReadPayload(mp4, resHandle, index);
+
+	counters = mp4->counters;
+	start = MP4Clock();
+	payload = ReadPayload(mp4, resHandle, index);
+	counters->read_ns += MP4Clock() - start;
+
+	if (payload)
+	{
+		counters->payloads++;
+		if (mp4->mediamap)
+			counters->bytes_mapped += mp4->metasizes[index]; // in place, or copied out of the mapping when unaligned
+		else
+			counters->bytes_read += mp4->metasizes[index];
+	}
+	return payload;
+}
+
+
 uint32_t WritePayload(size_t handle, uint32_t *payload, uint32_t payloadsize, uint32_t index)
 {
 	mp4object* mp4 = (mp4object*)handle;
@@ -203,10 +292,219 @@ uint32_t GetPayloadSize(size_t handle, uint32_t index)
 }
 
 
+static void MapMediaFile(mp4object *mp4, int32_t flags)
+{
+#ifndef _WINDOWS
+	if (mp4 && mp4->mediafp && (flags & MP4_FLAG_MEMORY_MAP) && !(flags & MP4_FLAG_READ_WRITE_MODE) && mp4->filesize <= (uint64_t)SIZE_MAX)
+	{
+		void *map = mmap(NULL, (size_t)mp4->filesize, PROT_READ, MAP_SHARED, fileno(mp4->mediafp), 0);
+		if (map != MAP_FAILED)
+			mp4->mediamap = (uint8_t *)map;  // on failure GetPayload() falls back to fseeko/fread
+	}
+#endif
+}
+
+
+/* Payload index sidecar cache (MP4_FLAG_INDEX_CACHE)
+*
+*  The payload table and timing fields produced by the atom walk are saved to
+*  <dir>/<hash>.gpmfidx, keyed by resolved path, file size, mtime and track type.
+*  A later open of the same unmodified file restores them without reading moov.
+*/
+#define MP4_INDEX_MAGIC		MAKEID('G', 'P', 'I', 'X')
+#define MP4_INDEX_VERSION	2	// 2: mtime in nanoseconds
+
+typedef struct mp4indexheader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t filesize;
+	int64_t mtime;						// nanoseconds (seconds on Windows), so a same-second rewrite misses
+	uint32_t traktype, traksubtype;
+	uint32_t pathlen;
+	uint32_t metasize_count;
+	uint32_t metastco_count;
+	uint32_t indexcount;
+	double videolength;
+	double metadatalength;
+	int32_t metadataoffset_clockcount;
+	uint32_t clockdemon, clockcount;
+	uint32_t trak_clockdemon, trak_clockcount;
+	uint32_t meta_clockdemon, meta_clockcount;
+	uint32_t video_framerate_numerator;
+	uint32_t video_framerate_denominator;
+	uint32_t video_frames;
+	double basemetadataduration;
+	int32_t trak_edit_list_offsets[MAX_TRACKS];
+	uint32_t trak_num;
+} mp4indexheader;
+
+static char mp4_index_dir[1024] = "";
+
+void SetMP4IndexCacheDirectory(const char *path)
+{
+	if (path == NULL)
+	{
+		mp4_index_dir[0] = 0;
+		return;
+	}
+	size_t len = strlen(path);
+	if (len >= sizeof(mp4_index_dir)) len = sizeof(mp4_index_dir) - 1;
+	memcpy(mp4_index_dir, path, len);
+	mp4_index_dir[len] = 0;
+}
+
+static void IndexCachePath(const char *fullpath, uint32_t traktype, uint32_t traksubtype, char *cachepath, size_t cachepathsize)
+{
+	uint64_t hash = 14695981039346656037ULL; // FNV-1a
+	const char *c;
+	for (c = fullpath; *c; c++)
+	{
+		hash ^= (uint8_t)*c;
+		hash *= 1099511628211ULL;
+	}
+	hash ^= ((uint64_t)traktype << 32) | traksubtype;
+	hash *= 1099511628211ULL;
+
+	snprintf(cachepath, cachepathsize, "%s/%016llx.gpmfidx", mp4_index_dir, (unsigned long long)hash);
+}
+
+static int ResolveIndexKey(const char *filename, char *fullpath, size_t fullpathsize)
+{
+	if (mp4_index_dir[0] == 0) return 0;
+#ifdef _WINDOWS
+	if (_fullpath(fullpath, filename, fullpathsize) == NULL) return 0;
+#else
+	char resolved[PATH_MAX];
+	if (realpath(filename, resolved) == NULL) return 0;
+	if (strlen(resolved) >= fullpathsize) return 0;
+	strcpy(fullpath, resolved);
+#endif
+	return 1;
+}
+
+static int LoadIndexCache(mp4object *mp4, const char *fullpath, int64_t mtime, uint32_t traktype, uint32_t traksubtype)
+{
+	char cachepath[1200];
+	char storedpath[1024];
+	mp4indexheader hdr;
+	int ok = 0;
+
+	IndexCachePath(fullpath, traktype, traksubtype, cachepath, sizeof(cachepath));
+
+	FILE *fp = fopen(cachepath, "rb");
+	if (fp == NULL) return 0;
+
+	if (fread(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr) &&
+		hdr.magic == MP4_INDEX_MAGIC && hdr.version == MP4_INDEX_VERSION &&
+		hdr.filesize == mp4->filesize && hdr.mtime == mtime &&
+		hdr.traktype == traktype && hdr.traksubtype == traksubtype &&
+		hdr.pathlen < sizeof(storedpath) && hdr.metasize_count > 0 && hdr.metasize_count < 5184000 &&
+		hdr.indexcount <= hdr.metasize_count && hdr.trak_num < MAX_TRACKS && // both index arrays sized by the header
+		fread(storedpath, 1, hdr.pathlen, fp) == hdr.pathlen)
+	{
+		storedpath[hdr.pathlen] = 0;
+		if (strcmp(storedpath, fullpath) == 0) // guard against hash collisions
+		{
+			mp4->metasizes = (uint32_t *)malloc(hdr.metasize_count * 4);
+			mp4->metaoffsets = (uint64_t *)malloc(hdr.metasize_count * 8);
+			if (mp4->metasizes && mp4->metaoffsets &&
+				fread(mp4->metasizes, 4, hdr.metasize_count, fp) == hdr.metasize_count &&
+				fread(mp4->metaoffsets, 8, hdr.metasize_count, fp) == hdr.metasize_count)
+			{
+				mp4->metasize_count = hdr.metasize_count;
+				mp4->metastco_count = hdr.metastco_count;
+				mp4->indexcount = hdr.indexcount;
+				mp4->videolength = hdr.videolength;
+				mp4->metadatalength = hdr.metadatalength;
+				mp4->metadataoffset_clockcount = hdr.metadataoffset_clockcount;
+				mp4->clockdemon = hdr.clockdemon;
+				mp4->clockcount = hdr.clockcount;
+				mp4->trak_clockdemon = hdr.trak_clockdemon;
+				mp4->trak_clockcount = hdr.trak_clockcount;
+				mp4->meta_clockdemon = hdr.meta_clockdemon;
+				mp4->meta_clockcount = hdr.meta_clockcount;
+				mp4->video_framerate_numerator = hdr.video_framerate_numerator;
+				mp4->video_framerate_denominator = hdr.video_framerate_denominator;
+				mp4->video_frames = hdr.video_frames;
+				mp4->basemetadataduration = hdr.basemetadataduration;
+				memcpy(mp4->trak_edit_list_offsets, hdr.trak_edit_list_offsets, sizeof(hdr.trak_edit_list_offsets));
+				mp4->trak_num = hdr.trak_num;
+				ok = 1;
+			}
+			else
+			{
+				if (mp4->metasizes) free(mp4->metasizes);
+				if (mp4->metaoffsets) free(mp4->metaoffsets);
+				mp4->metasizes = NULL;
+				mp4->metaoffsets = NULL;
+			}
+		}
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+static void SaveIndexCache(mp4object *mp4, const char *fullpath, int64_t mtime, uint32_t traktype, uint32_t traksubtype)
+{
+	char cachepath[1200];
+	char temppath[1240];
+	mp4indexheader hdr;
+
+	if (mp4->metasizes == NULL || mp4->metaoffsets == NULL || mp4->metasize_count == 0) return;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = MP4_INDEX_MAGIC;
+	hdr.version = MP4_INDEX_VERSION;
+	hdr.filesize = mp4->filesize;
+	hdr.mtime = mtime;
+	hdr.traktype = traktype;
+	hdr.traksubtype = traksubtype;
+	hdr.pathlen = (uint32_t)strlen(fullpath);
+	hdr.metasize_count = mp4->metasize_count;
+	hdr.metastco_count = mp4->metastco_count;
+	hdr.indexcount = mp4->indexcount;
+	hdr.videolength = mp4->videolength;
+	hdr.metadatalength = mp4->metadatalength;
+	hdr.metadataoffset_clockcount = mp4->metadataoffset_clockcount;
+	hdr.clockdemon = mp4->clockdemon;
+	hdr.clockcount = mp4->clockcount;
+	hdr.trak_clockdemon = mp4->trak_clockdemon;
+	hdr.trak_clockcount = mp4->trak_clockcount;
+	hdr.meta_clockdemon = mp4->meta_clockdemon;
+	hdr.meta_clockcount = mp4->meta_clockcount;
+	hdr.video_framerate_numerator = mp4->video_framerate_numerator;
+	hdr.video_framerate_denominator = mp4->video_framerate_denominator;
+	hdr.video_frames = mp4->video_frames;
+	hdr.basemetadataduration = mp4->basemetadataduration;
+	memcpy(hdr.trak_edit_list_offsets, mp4->trak_edit_list_offsets, sizeof(hdr.trak_edit_list_offsets));
+	hdr.trak_num = mp4->trak_num;
+
+	IndexCachePath(fullpath, traktype, traksubtype, cachepath, sizeof(cachepath));
+	// pid keeps processes apart, the object address keeps threads of one process apart
+	snprintf(temppath, sizeof(temppath), "%s.%d.%lx.tmp", cachepath, (int)getpid(), (unsigned long)(size_t)mp4);
+
+	// write aside and rename, so concurrent readers never see a partial index
+	FILE *fp = fopen(temppath, "wb");
+	if (fp == NULL) return;
+
+	int ok = fwrite(&hdr, 1, sizeof(hdr), fp) == sizeof(hdr) &&
+		fwrite(fullpath, 1, hdr.pathlen, fp) == hdr.pathlen &&
+		fwrite(mp4->metasizes, 4, mp4->metasize_count, fp) == mp4->metasize_count &&
+		fwrite(mp4->metaoffsets, 8, mp4->metasize_count, fp) == mp4->metasize_count;
+
+	if (fclose(fp) != 0) ok = 0;
+	if (!ok || rename(temppath, cachepath) != 0)
+		remove(temppath);
+}
+
+
 #define MAX_NEST_LEVEL	20
 
 size_t OpenMP4Source(char *filename, uint32_t traktype, uint32_t traksubtype, int32_t flags)  //RAW or within MP4
 {
+	uint64_t opened = MP4Clock();
 	mp4object *mp4 = (mp4object *)malloc(sizeof(mp4object));
 	if (mp4 == NULL) return 0;
 
@@ -234,6 +532,23 @@ size_t OpenMP4Source(char *filename, uint32_t traktype, uint32_t traksubtype, in
 	mp4->mediafp = fopen(filename, mode);
 #endif
 
+	char indexkey[1024];
+#if defined(_WINDOWS)
+	int64_t mtime = (int64_t)mp4stat.st_mtime;
+#elif defined(__APPLE__)
+	int64_t mtime = (int64_t)mp4stat.st_mtimespec.tv_sec * 1000000000 + mp4stat.st_mtimespec.tv_nsec;
+#else
+	int64_t mtime = (int64_t)mp4stat.st_mtim.tv_sec * 1000000000 + mp4stat.st_mtim.tv_nsec;
+#endif
+	int useindex = (flags & MP4_FLAG_INDEX_CACHE) && mp4->mediafp && ResolveIndexKey(filename, indexkey, sizeof(indexkey));
+
+	if (useindex && LoadIndexCache(mp4, indexkey, mtime, traktype, traksubtype))
+	{
+		MapMediaFile(mp4, flags);
+		mp4->open_ns = MP4Clock() - opened;
+		return (size_t)mp4;
+	}
+
 	if (mp4->mediafp)
 	{
 		uint32_t qttag, qtsize32, skip, type = 0, subtype = 0, num;
@@ -256,6 +571,8 @@ size_t OpenMP4Source(char *filename, uint32_t traktype, uint32_t traksubtype, in
 
 			if (len == 8 && mp4->filepos < mp4->filesize)
 			{
+				mp4->atoms++;
+
 				if (mp4->filepos == 8 && qttag != MAKEID('f', 't', 'y', 'p'))
 				{
 					CloseSource((size_t)mp4);
@@ -948,6 +1265,12 @@ size_t OpenMP4Source(char *filename, uint32_t traktype, uint32_t traksubtype, in
 			if (mp4 != NULL)
 			{
 				mp4->indexcount = mp4->metasize_count;
+				MapMediaFile(mp4, flags);
+
+				if (useindex)
+					SaveIndexCache(mp4, indexkey, mtime, traktype, traksubtype);
+
+				mp4->open_ns = MP4Clock() - opened;
 			}
 		}
 	}
@@ -994,6 +1317,13 @@ void CloseSource(size_t handle)
 		return;
 	}
 
+#ifndef _WINDOWS
+	if (mp4->mediamap)
+	{
+		munmap(mp4->mediamap, (size_t)mp4->filesize);
+		mp4->mediamap = NULL;
+	}
+#endif
 	if (mp4->mediafp)
 	{
 		fclose(mp4->mediafp);
@@ -1091,6 +1421,7 @@ uint32_t GetEditListOffsetRationalTime(size_t handle, int32_t *offset_numerator,
 
 size_t OpenMP4SourceUDTA(char *filename, int32_t flags)
 {
+	uint64_t opened = MP4Clock();
 	mp4object *mp4 = (mp4object *)malloc(sizeof(mp4object));
 	if (mp4 == NULL) return 0;
 
@@ -1139,6 +1470,8 @@ size_t OpenMP4SourceUDTA(char *filename, int32_t flags)
 
 			if (len == 8)
 			{
+				mp4->atoms++;
+
 				if (!VALID_FOURCC(qttag) && qttag != 0x7a7978a9)
 				{
 					mp4->filepos += len;
@@ -1203,6 +1536,8 @@ size_t OpenMP4SourceUDTA(char *filename, int32_t flags)
 					mp4->metaoffsets[0] = (uint64_t) LONGTELL(mp4->mediafp);
 					mp4->metasize_count = 1;
 
+					MapMediaFile(mp4, flags);
+					mp4->open_ns = MP4Clock() - opened;
 					return (size_t)mp4;  // not an MP4, RAW GPMF which has not inherent timing, assigning a during of 1second.
 				}
 				if (qttag != MAKEID('m', 'o', 'o', 'v') && //skip over all but these atoms
@@ -1224,6 +1559,8 @@ size_t OpenMP4SourceUDTA(char *filename, int32_t flags)
 				}
 			}
 		} while (len > 0);
+
+		mp4->open_ns = MP4Clock() - opened;
 	}
 	return (size_t)mp4;
 }
@@ -48,6 +48,17 @@ typedef struct SampleToChunk
 	uint32_t id;
 } SampleToChunk;
 
+typedef struct mp4counters
+{
+	uint64_t atoms;			// atoms visited by the moov walk (0 when the index came from the sidecar cache)
+	uint64_t open_ns;		// OpenMP4Source() time: atom walk or sidecar load, mapping included
+	uint64_t payloads;		// payloads returned by GetPayload()
+	uint64_t bytes_read;	// payload bytes read with fread
+	uint64_t bytes_mapped;	// payload bytes served from the mapping (MP4_FLAG_MEMORY_MAP)
+	uint64_t allocations;	// payload buffers allocated or grown by GetPayloadResource()
+	uint64_t read_ns;		// time in GetPayload()
+} mp4counters;
+
 #define MAX_TRACKS	16
 typedef struct mp4object
 {
@@ -73,11 +84,17 @@ typedef struct mp4object
 	FILE *mediafp;
 	uint64_t filesize;
 	uint64_t filepos;
+	uint8_t *mediamap;		// whole file mapped read-only (MP4_FLAG_MEMORY_MAP), NULL when using stdio
+	uint32_t atoms;			// atoms visited while opening
+	uint64_t open_ns;		// time spent opening
+	mp4counters *counters;	// optional, caller owned (see SetMP4Counters)
 } mp4object;
 
 enum mp4flag
 {
 	MP4_FLAG_READ_WRITE_MODE = 1 << 0,
+	MP4_FLAG_MEMORY_MAP = 1 << 1,		// map the file so GetPayload() returns pointers into the mapping (read-only, ignored with READ_WRITE)
+	MP4_FLAG_INDEX_CACHE = 1 << 2,		// load/save the payload index in the directory set by SetMP4IndexCacheDirectory()
 };
 
 typedef struct resObject
@@ -125,6 +142,8 @@ typedef enum MP4READER_ERROR
 size_t OpenMP4Source(char *filename, uint32_t traktype, uint32_t subtype, int32_t flags);
 size_t OpenMP4SourceUDTA(char *filename, int32_t flags);
 void CloseSource(size_t mp4Handle);
+void SetMP4IndexCacheDirectory(const char *path);	// NULL or "" disables MP4_FLAG_INDEX_CACHE
+void SetMP4Counters(size_t mp4Handle, mp4counters *counters);	// opt-in profiling: sets atoms/open_ns, then GetPayload() adds to the rest. Not atomic, NULL detaches
 float GetDuration(size_t mp4Handle);
 uint32_t GetVideoFrameRateAndCount(size_t mp4Handle, uint32_t *numer, uint32_t *demon);
 uint32_t GetNumberPayloads(size_t mp4Handle);
@@ -24,8 +24,16 @@
 #include <string.h>
 #include <stdint.h>
 
+#ifdef _WINDOWS
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <time.h>
+#endif
+
 #include "GPMF_parser.h"
 #include "GPMF_bitstream.h"
+#include "GPMF_simd.h"
 
 
 #ifdef DBG
@@ -209,6 +217,8 @@ GPMF_ERR GPMF_ResetState(GPMF_stream *ms)
 		ms->last_seek[ms->nest_level] = 0;
 		ms->device_id = 0;
 		ms->device_name[0] = 0;
+		if (ms->scratch)
+			ms->scratch->pos = 0; // the buffer may have been refilled, keep the allocation only
 
 		return GPMF_OK;
 	}
@@ -252,6 +262,70 @@ GPMF_ERR GPMF_Init(GPMF_stream *ms, uint32_t *buffer, uint32_t datasize)
 }
 
 
+GPMF_ERR GPMF_SetScratch(GPMF_stream *ms, GPMF_scratch *scratch)
+{
+	if (ms)
+	{
+		ms->scratch = scratch;
+		if (scratch)
+			scratch->pos = 0; // a new payload may sit at the address of the last one
+		return GPMF_OK;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
+GPMF_ERR GPMF_FreeScratch(GPMF_scratch *scratch)
+{
+	if (scratch)
+	{
+		if (scratch->buffer)
+			free(scratch->buffer);
+		memset(scratch, 0, sizeof(GPMF_scratch));
+		return GPMF_OK;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
+GPMF_ERR GPMF_SetCounters(GPMF_stream *ms, GPMF_counters *counters)
+{
+	if (ms)
+	{
+		ms->counters = counters;
+		return GPMF_OK;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
+/* Monotonic nanoseconds for the GPMF_counters timers, only read while counters are attached. */
+static uint64_t CounterClock(void)
+{
+#ifdef _WINDOWS
+	LARGE_INTEGER count, frequency;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&frequency);
+	return (uint64_t)((double)count.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+
+GPMF_ERR GPMF_SetCalibrationCache(GPMF_stream *ms, GPMF_calibration_cache *cache)
+{
+	if (ms)
+	{
+		ms->calibration = cache;
+		return GPMF_OK;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
 GPMF_ERR GPMF_CopyState(GPMF_stream *msrc, GPMF_stream *mdst)
 {
 	if (msrc && mdst)
@@ -273,6 +347,9 @@ GPMF_ERR GPMF_Next(GPMF_stream *ms, GPMF_LEVELS recurse)
 			uint32_t key, type = GPMF_SAMPLE_TYPE(ms->buffer[ms->pos + 1]);
 			uint32_t size = (GPMF_DATA_SIZE(ms->buffer[ms->pos + 1]) >> 2);
 
+			if (ms->counters)
+				ms->counters->klv_steps++;
+
 			if (GPMF_OK != IsValidSize(ms, size))
 			{
 				if (recurse & GPMF_TOLERANT && recurse & GPMF_RECURSE_LEVELS) // Skip this nest level as the sizes within this level are corrupt.
@@ -645,6 +722,149 @@ GPMF_ERR GPMF_SeekToSamples(GPMF_stream *ms)
 }
 
 
+static uint32_t IndexSlot(uint32_t device_id, uint32_t key)
+{
+	return ((device_id * 0x9E3779B1) ^ key ^ (key >> 15)) & (GPMF_INDEX_SLOTS - 1);
+}
+
+static void RestoreIndexed(GPMF_stream *ms, GPMF_index_entry *e)
+{
+	uint32_t i;
+
+	for (i = 0; i < GPMF_NEST_LIMIT; i++)
+	{
+		ms->last_level_pos[i] = i < GPMF_INDEX_LEVELS ? e->last_level_pos[i] : 0;
+		ms->nest_size[i] = i < GPMF_INDEX_LEVELS ? e->nest_size[i] : 0;
+		ms->last_seek[i] = i < GPMF_INDEX_LEVELS ? e->last_seek[i] : 0;
+	}
+	ms->pos = e->pos;
+	ms->nest_level = e->nest_level;
+	ms->device_count = e->device_count;
+	ms->device_id = e->device_id;
+	memcpy(ms->device_name, e->device_name, sizeof(ms->device_name));
+}
+
+
+GPMF_ERR GPMF_BuildIndex(GPMF_stream *ms, GPMF_index *index)
+{
+	if (ms && index)
+	{
+		GPMF_stream gs, ds;
+		uint32_t i;
+
+		index->buffer = ms->buffer;
+		index->count = 0;
+		index->complete = 1;
+		memset(index->slot, 0, sizeof(index->slot));
+
+		GPMF_CopyState(ms, &gs);
+		GPMF_ResetState(&gs);
+		while (GPMF_OK == GPMF_FindNext(&gs, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS))
+		{
+			GPMF_index_entry *e;
+			uint32_t slot;
+
+			GPMF_CopyState(&gs, &ds);
+			if (GPMF_OK != GPMF_SeekToSamples(&ds))
+				continue;
+
+			if (ds.nest_level >= GPMF_INDEX_LEVELS)
+			{
+				index->complete = 0; // too deep to restore from an entry, GPMF_FindIndexed walks to it
+				continue;
+			}
+
+			if (index->count >= GPMF_INDEX_ENTRIES)
+			{
+				index->complete = 0; // the STRMs indexed so far remain usable
+				break;
+			}
+
+			e = &index->entry[index->count];
+			e->device_id = ds.device_id;
+			e->key = GPMF_Key(&ds);
+			e->pos = ds.pos;
+			e->nest_level = ds.nest_level;
+			e->device_count = ds.device_count;
+			for (i = 0; i < GPMF_INDEX_LEVELS; i++)
+			{
+				e->last_level_pos[i] = ds.last_level_pos[i];
+				e->nest_size[i] = ds.nest_size[i];
+				e->last_seek[i] = ds.last_seek[i];
+			}
+			memcpy(e->device_name, ds.device_name, sizeof(e->device_name));
+
+			// first STRM wins when a (DVID, FourCC) pair repeats
+			slot = IndexSlot(e->device_id, e->key);
+			while (index->slot[slot] && (index->entry[index->slot[slot] - 1].device_id != e->device_id || index->entry[index->slot[slot] - 1].key != e->key))
+				slot = (slot + 1) & (GPMF_INDEX_SLOTS - 1);
+			if (index->slot[slot] == 0)
+				index->slot[slot] = (uint8_t)(index->count + 1);
+
+			index->count++;
+		}
+		return index->complete ? GPMF_OK : GPMF_ERROR_MEMORY;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
+/* The walk GPMF_FindIndexed falls back to for STRMs an incomplete index does not hold. */
+static GPMF_ERR FindUnindexed(GPMF_stream *ms, uint32_t device_id, uint32_t fourcc)
+{
+	GPMF_stream gs, ds;
+
+	GPMF_CopyState(ms, &gs);
+	GPMF_ResetState(&gs);
+	while (GPMF_OK == GPMF_FindNext(&gs, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS))
+	{
+		GPMF_CopyState(&gs, &ds);
+		if (GPMF_OK == GPMF_SeekToSamples(&ds) && ds.device_id == device_id && GPMF_Key(&ds) == fourcc)
+		{
+			GPMF_CopyState(&ds, ms);
+			return GPMF_OK;
+		}
+	}
+	return GPMF_ERROR_FIND;
+}
+
+
+GPMF_ERR GPMF_FindIndexed(GPMF_stream *ms, GPMF_index *index, uint32_t device_id, uint32_t fourcc)
+{
+	if (ms && index && index->buffer == ms->buffer)
+	{
+		uint32_t slot = IndexSlot(device_id, fourcc);
+
+		while (index->slot[slot])
+		{
+			GPMF_index_entry *e = &index->entry[index->slot[slot] - 1];
+			if (e->device_id == device_id && e->key == fourcc)
+			{
+				RestoreIndexed(ms, e);
+				return GPMF_OK;
+			}
+			slot = (slot + 1) & (GPMF_INDEX_SLOTS - 1);
+		}
+		return index->complete ? GPMF_ERROR_FIND : FindUnindexed(ms, device_id, fourcc);
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
+GPMF_ERR GPMF_SeekToIndexed(GPMF_stream *ms, GPMF_index *index, uint32_t n)
+{
+	if (ms && index && index->buffer == ms->buffer)
+	{
+		if (n >= index->count)
+			return GPMF_ERROR_BUFFER_END;
+
+		RestoreIndexed(ms, &index->entry[n]);
+		return GPMF_OK;
+	}
+	return GPMF_ERROR_MEMORY;
+}
+
+
 GPMF_ERR GPMF_FindPrev(GPMF_stream *ms, uint32_t fourcc, GPMF_LEVELS recurse)
 {
 	GPMF_stream prevstate;
@@ -1472,7 +1692,299 @@ GPMF_ERR GPMF_FormattedData(GPMF_stream *ms, void *buffer, uint32_t buffersize,
 
 
 
-GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uint32_t sample_offset, uint32_t read_samples, GPMF_SampleType outputType)
+#define CALIBRATION_SCAL	0
+#define CALIBRATION_MTRX	1
+#define CALIBRATION_ORIN	2
+#define CALIBRATION_ORIO	3
+#define CALIBRATION_TYPE	4
+#define CALIBRATION_KLVS	5
+
+/* Resolves the SCAL, MTRX and ORIN/ORIO calibration of the KLV at ms->pos into 'cal' (native endian,
+ * matrix in 'outputType' when built from ORIN/ORIO). */
+static GPMF_ERR ResolveCalibration(GPMF_stream *ms, uint32_t elements, GPMF_SampleType outputType, GPMF_calibration *cal)
+{
+	uint8_t scal_type = 0;
+	uint8_t scal_count = 0;
+	uint32_t scal_typesize = 0;
+	uint32_t *scal_data = NULL;
+	uint32_t *scal_buffer = (uint32_t *)cal->scal;
+	uint32_t scal_buffersize = sizeof(cal->scal);
+
+	uint8_t mtrx_type = 0;
+	uint8_t mtrx_count = 0;
+	uint32_t mtrx_typesize = 0;
+	uint32_t mtrx_sample_size = 0;
+	uint32_t *mtrx_data = NULL;
+	uint32_t *mtrx_buffer = (uint32_t *)cal->mtrx;
+	uint32_t mtrx_buffersize = sizeof(cal->mtrx);
+	uint32_t mtrx_calibration = 0;
+
+	char *orin_data = NULL;
+	uint32_t orin_len = 0;
+	char *orio_data = NULL;
+	uint32_t orio_len = 0;
+
+	GPMF_stream fs;
+	GPMF_CopyState(ms, &fs);
+
+	if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_SCALE, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+	{
+		scal_data = (uint32_t *)GPMF_RawData(&fs);
+		scal_type = GPMF_SAMPLE_TYPE(fs.buffer[fs.pos + 1]);
+
+		switch (scal_type)
+		{
+		case GPMF_TYPE_SIGNED_BYTE:
+		case GPMF_TYPE_UNSIGNED_BYTE:
+		case GPMF_TYPE_SIGNED_SHORT:
+		case GPMF_TYPE_UNSIGNED_SHORT:
+		case GPMF_TYPE_SIGNED_LONG:
+		case GPMF_TYPE_UNSIGNED_LONG:
+		case GPMF_TYPE_FLOAT:
+			scal_count = GPMF_SAMPLES(fs.buffer[fs.pos + 1]);
+			scal_typesize = GPMF_SizeofType((GPMF_SampleType)scal_type);
+
+			if (scal_count > 1)
+			{
+				if (scal_count != elements)
+				{
+					return GPMF_ERROR_SCALE_COUNT;
+				}
+			}
+
+			GPMF_FormattedData(&fs, scal_buffer, scal_buffersize, 0, scal_count);
+
+			scal_data = (uint32_t *)scal_buffer;
+			break;
+		default:
+			return GPMF_ERROR_SCALE_NOT_SUPPORTED;
+			break;
+		}
+	}
+	else
+	{
+		scal_type = 'L';
+		scal_count = 1;
+		scal_buffer[0] = 1; // set the scale to 1 is no scale was provided
+		scal_data = (uint32_t *)scal_buffer;
+	}
+
+	GPMF_CopyState(ms, &fs);
+	if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_MATRIX, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+	{
+		uint32_t mtrx_found_size = 0;
+		uint32_t matrix_size = elements * elements;
+		mtrx_data = (uint32_t *)GPMF_RawData(&fs);
+		mtrx_type = GPMF_SAMPLE_TYPE(fs.buffer[fs.pos + 1]);
+
+		switch (mtrx_type)
+		{
+		case GPMF_TYPE_SIGNED_BYTE:
+		case GPMF_TYPE_UNSIGNED_BYTE:
+		case GPMF_TYPE_SIGNED_SHORT:
+		case GPMF_TYPE_UNSIGNED_SHORT:
+		case GPMF_TYPE_SIGNED_LONG:
+		case GPMF_TYPE_UNSIGNED_LONG:
+		case GPMF_TYPE_FLOAT:
+		case GPMF_TYPE_DOUBLE:
+			mtrx_count = GPMF_SAMPLES(fs.buffer[fs.pos + 1]);
+			mtrx_sample_size = GPMF_SAMPLE_SIZE(fs.buffer[fs.pos + 1]);
+			mtrx_typesize = GPMF_SizeofType((GPMF_SampleType)mtrx_type);
+			mtrx_found_size = mtrx_count * mtrx_sample_size / mtrx_typesize;
+			if (mtrx_found_size != matrix_size)  // e.g XYZ is a 3x3 matrix, RGBA is a 4x4 matrix
+			{
+				return GPMF_ERROR_SCALE_COUNT;
+			}
+			
+			GPMF_FormattedData(&fs, mtrx_buffer, mtrx_buffersize, 0, mtrx_count);
+			mtrx_data = (uint32_t *)mtrx_buffer;
+			break;
+		default:
+			return GPMF_ERROR_SCALE_NOT_SUPPORTED;
+			break;
+		}
+
+		switch (mtrx_type)
+		{
+		case GPMF_TYPE_SIGNED_BYTE:  MACRO_IS_MATRIX_CALIBRATION(int8_t) break;
+		case GPMF_TYPE_UNSIGNED_BYTE:  MACRO_IS_MATRIX_CALIBRATION(uint8_t) break;
+		case GPMF_TYPE_SIGNED_SHORT:  MACRO_IS_MATRIX_CALIBRATION(int16_t) break;
+		case GPMF_TYPE_UNSIGNED_SHORT:  MACRO_IS_MATRIX_CALIBRATION(uint16_t) break;
+		case GPMF_TYPE_SIGNED_LONG:  MACRO_IS_MATRIX_CALIBRATION(int32_t) break;
+		case GPMF_TYPE_UNSIGNED_LONG:  MACRO_IS_MATRIX_CALIBRATION(uint32_t) break;
+		case GPMF_TYPE_FLOAT: MACRO_IS_MATRIX_CALIBRATION(float); break;
+		case GPMF_TYPE_DOUBLE: MACRO_IS_MATRIX_CALIBRATION(double); break;
+		}
+	}
+
+	if (!mtrx_calibration)
+	{
+		GPMF_CopyState(ms, &fs);
+		if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_ORIENTATION_IN, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+		{
+			orin_data = (char *)GPMF_RawData(&fs);
+			orin_len = GPMF_DATA_PACKEDSIZE(fs.buffer[fs.pos + 1]);
+		}
+		GPMF_CopyState(ms, &fs);
+		if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_ORIENTATION_OUT, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+		{
+			orio_data = (char *)GPMF_RawData(&fs);
+			orio_len = GPMF_DATA_PACKEDSIZE(fs.buffer[fs.pos + 1]);
+		}
+		if (orio_len == orin_len && orin_len > 1 && orio_len == elements &&
+			elements * elements * GPMF_SizeofType(outputType) <= sizeof(cal->mtrx))
+		{
+			uint32_t x, y, pos = 0;
+
+			mtrx_data = (uint32_t*)mtrx_buffer;
+			mtrx_type = outputType;
+
+			for (y = 0; y < elements; y++)
+			{
+				for (x = 0; x < elements; x++)
+				{
+					switch (mtrx_type)
+					{
+					case GPMF_TYPE_FLOAT:			MACRO_SET_MATRIX(float,       orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_DOUBLE:			MACRO_SET_MATRIX(double,      orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_SIGNED_BYTE:		MACRO_SET_MATRIX(int8_t,      orio_data[y], orin_data[x], pos);   break;
+					case GPMF_TYPE_UNSIGNED_BYTE:	MACRO_SET_MATRIX(uint8_t,     orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_SIGNED_SHORT:	MACRO_SET_MATRIX(int16_t,     orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_UNSIGNED_SHORT:  MACRO_SET_MATRIX(uint16_t,    orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_SIGNED_LONG:		MACRO_SET_MATRIX(int32_t,     orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_UNSIGNED_LONG:	MACRO_SET_MATRIX(uint32_t,    orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_SIGNED_64BIT_INT:  MACRO_SET_MATRIX(int64_t,   orio_data[y], orin_data[x], pos);  break;
+					case GPMF_TYPE_UNSIGNED_64BIT_INT: MACRO_SET_MATRIX(uint64_t, orio_data[y], orin_data[x], pos);  break;
+					default:
+						return GPMF_ERROR_SCALE_NOT_SUPPORTED;
+						break;
+					}
+
+					pos++;
+				}
+			}
+
+			mtrx_calibration = 1;
+		}
+	}
+
+	(void)scal_data;
+	cal->scal_type = scal_type;
+	cal->scal_count = scal_count;
+	cal->scal_typesize = scal_typesize;
+	cal->mtrx_type = mtrx_type;
+	cal->mtrx_calibration = (uint8_t)mtrx_calibration;
+	return GPMF_OK;
+}
+
+
+/* One pass over the STRM level collecting the first SCAL, MTRX, ORIN, ORIO and TYPE before the
+ * data KLV, i.e. the KLVs GPMF_FindPrev(..., GPMF_CURRENT_LEVEL|GPMF_TOLERANT) would return for
+ * each key. Returns 0 at the top level. */
+static uint32_t FindCalibrationKLVs(GPMF_stream *ms, uint32_t *klv[CALIBRATION_KLVS])
+{
+	static const uint32_t keys[CALIBRATION_KLVS] = { GPMF_KEY_SCALE, GPMF_KEY_MATRIX, GPMF_KEY_ORIENTATION_IN, GPMF_KEY_ORIENTATION_OUT, GPMF_KEY_TYPE };
+	uint32_t level = ms->nest_level, i;
+	GPMF_stream fs;
+
+	for (i = 0; i < CALIBRATION_KLVS; i++)
+		klv[i] = NULL;
+
+	if (level == 0 || ms->pos >= ms->buffer_size_longs)
+		return 0;
+
+	GPMF_CopyState(ms, &fs);
+	fs.last_seek[level] = fs.pos;
+	fs.pos = fs.last_level_pos[level - 1] + 2;
+	fs.nest_size[level] += fs.last_seek[level] - fs.pos;
+	do
+	{
+		if (fs.last_seek[level] <= fs.pos)
+			break;
+		for (i = 0; i < CALIBRATION_KLVS; i++)
+			if (klv[i] == NULL && fs.buffer[fs.pos] == keys[i])
+				klv[i] = &fs.buffer[fs.pos];
+	} while (GPMF_OK == GPMF_Next(&fs, GPMF_CURRENT_LEVEL|GPMF_TOLERANT));
+
+	return 1;
+}
+
+
+/* Returns the cache entry resolved from the same SCAL/MTRX/ORIN/ORIO bytes, element count and output
+ * type. On a miss the next entry is recycled: it comes back keyed but not valid, for the caller to
+ * resolve. NULL when the KLVs don't fit an entry. */
+static GPMF_calibration *CalibrationEntry(GPMF_calibration_cache *cache, uint32_t *klv[CALIBRATION_KLVS], uint32_t *end, uint32_t elements, GPMF_SampleType outputType)
+{
+	uint32_t raw[GPMF_CALIBRATION_RAW_LONGS];
+	uint32_t longs = 0, i;
+	GPMF_calibration *cal;
+
+	for (i = CALIBRATION_SCAL; i <= CALIBRATION_ORIO; i++)
+	{
+		if (klv[i])
+		{
+			uint32_t n = 2 + (GPMF_DATA_SIZE(klv[i][1]) >> 2);
+			if (klv[i] + n > end || longs + n > GPMF_CALIBRATION_RAW_LONGS)
+				return NULL;
+			memcpy(&raw[longs], klv[i], n * 4);
+			longs += n;
+		}
+	}
+
+	for (i = 0; i < GPMF_CALIBRATION_ENTRIES; i++)
+	{
+		cal = &cache->entry[i];
+		if (cal->valid && cal->elements == elements && cal->outputType == (uint32_t)outputType &&
+			cal->raw_longs == longs && 0 == memcmp(cal->raw, raw, longs * 4))
+			return cal;
+	}
+
+	cal = &cache->entry[cache->next];
+	cache->next = (cache->next + 1) % GPMF_CALIBRATION_ENTRIES;
+	cal->valid = 0;
+	cal->elements = elements;
+	cal->outputType = (uint32_t)outputType;
+	cal->raw_longs = longs;
+	memcpy(cal->raw, raw, longs * 4);
+	return cal;
+}
+
+
+/* Expands the TYPE KLV 'klv' (found at the STRM level) through the cache's last expansion, or
+ * expands it and remembers it. Returns 0 when 'klv' is missing, too big or not a valid TYPE. */
+static uint32_t CachedComplexTYPE(GPMF_calibration_cache *cache, uint32_t *klv, uint32_t *end, char *complextype, uint32_t *typestringlength)
+{
+	uint32_t n, len = sizeof(cache->complextype);
+
+	if (klv == NULL)
+		return 0;
+
+	n = 2 + (GPMF_DATA_SIZE(klv[1]) >> 2);
+	if (klv + n > end || n > GPMF_CALIBRATION_TYPE_LONGS)
+		return 0;
+
+	if (cache->type_longs != n || memcmp(cache->type_raw, klv, n * 4))
+	{
+		cache->type_longs = 0;
+		if (GPMF_OK != GPMF_ExpandComplexTYPE((char *)&klv[2], GPMF_DATA_PACKEDSIZE(klv[1]), cache->complextype, &len))
+			return 0;
+		cache->complextype_length = len;
+		cache->type_longs = n;
+		memcpy(cache->type_raw, klv, n * 4);
+	}
+
+	if (cache->complextype_length > *typestringlength)
+		return 0;
+
+	memcpy(complextype, cache->complextype, cache->complextype_length);
+	*typestringlength = cache->complextype_length;
+	return 1;
+}
+
+
+
+/* 'scaled' receives the number of samples written, read_samples clamped to the samples in the KLV. */
+static GPMF_ERR ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uint32_t sample_offset, uint32_t read_samples, GPMF_SampleType outputType, uint32_t *scaled)
 {
 	if (ms && buffer)
 	{
@@ -1492,24 +2004,17 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 		uint8_t scal_count = 0;
 		uint32_t scal_typesize = 0;
 		uint32_t *scal_data = NULL;
-		uint32_t scal_buffer[64];
-		uint32_t scal_buffersize = sizeof(scal_buffer);
 
 		uint8_t mtrx_type = 0;
-		uint8_t mtrx_count = 0;
-		uint32_t mtrx_typesize = 0;
-		uint32_t mtrx_sample_size = 0;
 		uint32_t *mtrx_data = NULL;
-		uint32_t mtrx_buffer[64];
-		uint32_t mtrx_buffersize = sizeof(mtrx_buffer);
 		uint32_t mtrx_calibration = 0;
 
-		char *orin_data = NULL;
-		uint32_t orin_len = 0;
-		char *orio_data = NULL;
-		uint32_t orio_len = 0;
+		GPMF_calibration calibration;	// used when no cache is attached
+		GPMF_scratch local_scratch = { 0 };	// used when no scratch is attached, freed before returning
+		GPMF_scratch *scratch = ms->scratch ? ms->scratch : &local_scratch;
+		uint32_t *calibration_klv[CALIBRATION_KLVS];
+		uint32_t calibration_walked = 0;
 
-		uint32_t *uncompressedSamples = NULL;
 		uint32_t elements = 1;
 		uint32_t noswap = 0;
 
@@ -1518,6 +2023,9 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 		if (type == GPMF_TYPE_NEST)
 			return GPMF_ERROR_MEMORY;
 
+		if (ms->calibration)
+			calibration_walked = FindCalibrationKLVs(ms, calibration_klv);
+
 		if (type == GPMF_TYPE_COMPRESSED)
 		{
 			uint32_t neededunc = GPMF_FormattedDataSize(ms);
@@ -1526,34 +2034,55 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 			remaining_sample_size = GPMF_DATA_PACKEDSIZE(ms->buffer[ms->pos + 2]);
 			total_sample_data_bytes = remaining_sample_size;
 
-			uncompressedSamples = (uint32_t *)malloc(neededunc + 12);
-			if (uncompressedSamples)
+			// Decoded once per KLV into the scratch, so reading the same block in several sample_offset
+			// chunks costs a single decode, and an attached scratch allocates only when it must grow.
+			if (scratch->pos != ms->pos + 1 || scratch->source != ms->buffer)
 			{
-				if (GPMF_OK == GPMF_FormattedData(ms, uncompressedSamples, neededunc, 0, samples))
+				scratch->pos = 0;
+				if (scratch->size < neededunc + 12)
+				{
+					if (scratch->buffer)
+						free(scratch->buffer);
+					scratch->buffer = (uint32_t *)malloc(neededunc + 12);
+					scratch->size = scratch->buffer ? neededunc + 12 : 0;
+					if (ms->counters)
+						ms->counters->allocations++;
+				}
+
+				// decoded straight into native samples, no big-endian round trip
+				if (scratch->buffer && GPMF_OK == GPMF_DecompressTo(ms, scratch->buffer, neededunc, GPMF_Type(ms)))
 				{
+					scratch->pos = ms->pos + 1;
+					scratch->source = ms->buffer;
+				}
+			}
+
+			if (scratch->pos)
+			{
+				if (read_samples > samples)
 					read_samples = samples;
-					elements = GPMF_ElementsInStruct(ms);
-					type = GPMF_Type(ms);
-					complextype[0] = (char)type;
-					inputtypesize = GPMF_SizeofType((GPMF_SampleType)type);
-					if (inputtypesize == 0)
-					{
-						ret = GPMF_ERROR_MEMORY;
-						goto cleanup;
-					}
-					inputtypeelements = 1;
-					noswap = 1; // data is formatted to LittleEndian
+				sample_size = GPMF_SAMPLE_SIZE(ms->buffer[ms->pos + 2]); // uncompressed struct, the '#' KLV itself is a byte stream
+				elements = GPMF_ElementsInStruct(ms);
+				type = GPMF_Type(ms);
+				complextype[0] = (char)type;
+				inputtypesize = GPMF_SizeofType((GPMF_SampleType)type);
+				if (inputtypesize == 0)
+				{
+					ret = GPMF_ERROR_MEMORY;
+					goto cleanup;
+				}
+				inputtypeelements = 1;
+				noswap = 1; // data is formatted to LittleEndian
 
-					data = (uint8_t *)uncompressedSamples;
+				data = (uint8_t *)scratch->buffer;
 
-					remaining_sample_size -= sample_offset * sample_size; // skip samples
-					data += sample_offset * sample_size;
+				remaining_sample_size -= sample_offset * sample_size; // skip samples
+				data += sample_offset * sample_size;
 
-					if (remaining_sample_size < sample_size * read_samples)
-					{
-						ret = GPMF_ERROR_MEMORY;
-						goto cleanup;
-					}
+				if (sample_offset > samples || remaining_sample_size < sample_size * read_samples)
+				{
+					ret = GPMF_ERROR_MEMORY;
+					goto cleanup;
 				}
 			}
 		}
@@ -1561,6 +2090,7 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 		{
 
 			GPMF_stream find_stream;
+			uint32_t typestringlength = sizeof(complextype);
 			GPMF_CopyState(ms, &find_stream);
 
 			remaining_sample_size -= sample_offset * sample_size; // skip samples
@@ -1569,22 +2099,23 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 			if (remaining_sample_size < sample_size * read_samples)
 				return GPMF_ERROR_MEMORY;
 
-			if (GPMF_OK == GPMF_FindPrev(&find_stream, GPMF_KEY_TYPE, GPMF_RECURSE_LEVELS|GPMF_TOLERANT))
+			if (!calibration_walked || !CachedComplexTYPE(ms->calibration, calibration_klv[CALIBRATION_TYPE],
+				ms->buffer + ms->buffer_size_longs, complextype, &typestringlength))
 			{
-				char *data1 = (char *)GPMF_RawData(&find_stream);
-				uint32_t size = GPMF_RawDataSize(&find_stream);
-				uint32_t typestringlength = sizeof(complextype);
-				if (GPMF_OK == GPMF_ExpandComplexTYPE(data1, size, complextype, &typestringlength))
+				if (GPMF_OK == GPMF_FindPrev(&find_stream, GPMF_KEY_TYPE, GPMF_RECURSE_LEVELS|GPMF_TOLERANT))
 				{
-					inputtypeelements = elements = typestringlength;
-
-					if (sample_size != GPMF_SizeOfComplexTYPE(complextype, typestringlength))
+					char *data1 = (char *)GPMF_RawData(&find_stream);
+					uint32_t size = GPMF_RawDataSize(&find_stream);
+					if (GPMF_OK != GPMF_ExpandComplexTYPE(data1, size, complextype, &typestringlength))
 						return GPMF_ERROR_TYPE_NOT_SUPPORTED;
 				}
 				else
 					return GPMF_ERROR_TYPE_NOT_SUPPORTED;
 			}
-			else
+
+			inputtypeelements = elements = typestringlength;
+
+			if (sample_size != GPMF_SizeOfComplexTYPE(complextype, typestringlength))
 				return GPMF_ERROR_TYPE_NOT_SUPPORTED;
 		}
 		else
@@ -1615,6 +2146,7 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 			ret = GPMF_ERROR_MEMORY;
 			goto cleanup;
 		}
+		*scaled = read_samples; // the conversion loops below count read_samples down
 
 		switch (outputType)	{
 		case GPMF_TYPE_SIGNED_BYTE:
@@ -1627,154 +2159,88 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 		case GPMF_TYPE_DOUBLE:
 			// All supported formats.
 		{
-			GPMF_stream fs;
-			GPMF_CopyState(ms, &fs);
+			// The calibration repeats in every payload of a stream: with a cache attached it is
+			// resolved once and reused while the SCAL/MTRX/ORIN/ORIO bytes stay the same.
+			GPMF_calibration *cal = NULL;
 
-			if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_SCALE, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+			if (ms->calibration && calibration_walked)
+				cal = CalibrationEntry(ms->calibration, calibration_klv, ms->buffer + ms->buffer_size_longs, elements, outputType);
+			if (cal == NULL)
 			{
-				scal_data = (uint32_t *)GPMF_RawData(&fs);
-				scal_type = GPMF_SAMPLE_TYPE(fs.buffer[fs.pos + 1]);
-
-				switch (scal_type)
-				{
-				case GPMF_TYPE_SIGNED_BYTE:
-				case GPMF_TYPE_UNSIGNED_BYTE:
-				case GPMF_TYPE_SIGNED_SHORT:
-				case GPMF_TYPE_UNSIGNED_SHORT:
-				case GPMF_TYPE_SIGNED_LONG:
-				case GPMF_TYPE_UNSIGNED_LONG:
-				case GPMF_TYPE_FLOAT:
-					scal_count = GPMF_SAMPLES(fs.buffer[fs.pos + 1]);
-					scal_typesize = GPMF_SizeofType((GPMF_SampleType)scal_type);
-
-					if (scal_count > 1)
-					{
-						if (scal_count != elements)
-						{
-							ret = GPMF_ERROR_SCALE_COUNT;
-							goto cleanup;
-						}
-					}
-
-					GPMF_FormattedData(&fs, scal_buffer, scal_buffersize, 0, scal_count);
-
-					scal_data = (uint32_t *)scal_buffer;
-					break;
-				default:
-					return GPMF_ERROR_SCALE_NOT_SUPPORTED;
-					break;
-				}
+				cal = &calibration;
+				cal->valid = 0;
 			}
-			else
+
+			if (!cal->valid)
 			{
-				scal_type = 'L';
-				scal_count = 1;
-				scal_buffer[0] = 1; // set the scale to 1 is no scale was provided
-				scal_data = (uint32_t *)scal_buffer;
+				ret = ResolveCalibration(ms, elements, outputType, cal);
+				if (ret != GPMF_OK)
+					goto cleanup;
+				cal->valid = 1;
 			}
 
-			GPMF_CopyState(ms, &fs);
-			if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_MATRIX, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
-			{
-				uint32_t mtrx_found_size = 0;
-				uint32_t matrix_size = elements * elements;
-				mtrx_data = (uint32_t *)GPMF_RawData(&fs);
-				mtrx_type = GPMF_SAMPLE_TYPE(fs.buffer[fs.pos + 1]);
+			scal_type = cal->scal_type;
+			scal_count = cal->scal_count;
+			scal_typesize = cal->scal_typesize;
+			scal_data = (uint32_t *)cal->scal;
+			mtrx_type = cal->mtrx_type;
+			mtrx_data = (uint32_t *)cal->mtrx;
+			mtrx_calibration = cal->mtrx_calibration;
+		}
 
-				switch (mtrx_type)
-				{
-				case GPMF_TYPE_SIGNED_BYTE:
-				case GPMF_TYPE_UNSIGNED_BYTE:
-				case GPMF_TYPE_SIGNED_SHORT:
-				case GPMF_TYPE_UNSIGNED_SHORT:
-				case GPMF_TYPE_SIGNED_LONG:
-				case GPMF_TYPE_UNSIGNED_LONG:
-				case GPMF_TYPE_FLOAT:
-				case GPMF_TYPE_DOUBLE:
-					mtrx_count = GPMF_SAMPLES(fs.buffer[fs.pos + 1]);
-					mtrx_sample_size = GPMF_SAMPLE_SIZE(fs.buffer[fs.pos + 1]);
-					mtrx_typesize = GPMF_SizeofType((GPMF_SampleType)mtrx_type);
-					mtrx_found_size = mtrx_count * mtrx_sample_size / mtrx_typesize;
-					if (mtrx_found_size != matrix_size)  // e.g XYZ is a 3x3 matrix, RGBA is a 4x4 matrix
-					{
-						ret = GPMF_ERROR_SCALE_COUNT;
-						goto cleanup;
-					}
-					
-					GPMF_FormattedData(&fs, mtrx_buffer, mtrx_buffersize, 0, mtrx_count);
-					mtrx_data = (uint32_t *)mtrx_buffer;
-					break;
-				default:
-					return GPMF_ERROR_SCALE_NOT_SUPPORTED;
-					break;
-				}
+		// Homogeneous streams (one input type for every element) are swapped, converted and scaled
+		// by the vectorized kernels; the matrix, if any, is applied afterwards exactly as below.
+		if (inputtypeelements == 1 && (!mtrx_calibration || elements <= 8) &&
+			GPMF_SIMD_Supported((GPMF_SampleType)complextype[0], outputType, elements))
+		{
+			double scale[GPMF_SIMD_MAX_ELEMENTS];
+			uint32_t i, count = read_samples * elements;
 
-				switch (mtrx_type)
+			for (i = 0; i < elements; i++)
+			{
+				uint8_t *scal_data8 = (uint8_t *)scal_data + (scal_count > 1 ? i * scal_typesize : 0);
+				switch (scal_type)
 				{
-				case GPMF_TYPE_SIGNED_BYTE:  MACRO_IS_MATRIX_CALIBRATION(int8_t) break;
-				case GPMF_TYPE_UNSIGNED_BYTE:  MACRO_IS_MATRIX_CALIBRATION(uint8_t) break;
-				case GPMF_TYPE_SIGNED_SHORT:  MACRO_IS_MATRIX_CALIBRATION(int16_t) break;
-				case GPMF_TYPE_UNSIGNED_SHORT:  MACRO_IS_MATRIX_CALIBRATION(uint16_t) break;
-				case GPMF_TYPE_SIGNED_LONG:  MACRO_IS_MATRIX_CALIBRATION(int32_t) break;
-				case GPMF_TYPE_UNSIGNED_LONG:  MACRO_IS_MATRIX_CALIBRATION(uint32_t) break;
-				case GPMF_TYPE_FLOAT: MACRO_IS_MATRIX_CALIBRATION(float); break;
-				case GPMF_TYPE_DOUBLE: MACRO_IS_MATRIX_CALIBRATION(double); break;
+				case GPMF_TYPE_SIGNED_BYTE:		scale[i] = (double)*((int8_t *)scal_data8);	break;
+				case GPMF_TYPE_UNSIGNED_BYTE:	scale[i] = (double)*((uint8_t *)scal_data8);	break;
+				case GPMF_TYPE_SIGNED_SHORT:	scale[i] = (double)*((int16_t *)scal_data8);	break;
+				case GPMF_TYPE_UNSIGNED_SHORT:	scale[i] = (double)*((uint16_t *)scal_data8);	break;
+				case GPMF_TYPE_SIGNED_LONG:		scale[i] = (double)*((int32_t *)scal_data8);	break;
+				case GPMF_TYPE_UNSIGNED_LONG:	scale[i] = (double)*((uint32_t *)scal_data8);	break;
+				case GPMF_TYPE_FLOAT:			scale[i] = (double)*((float *)scal_data8);	break;
+				default:
+					ret = GPMF_ERROR_SCALE_NOT_SUPPORTED;
+					goto cleanup;
 				}
 			}
 
-			if (!mtrx_calibration)
+			if (outputType == GPMF_TYPE_DOUBLE)
+				GPMF_SIMD_ScaleToDouble(data, (GPMF_SampleType)complextype[0], !noswap, scale, elements, (double *)output, count);
+			else
+				GPMF_SIMD_ScaleToFloat(data, (GPMF_SampleType)complextype[0], !noswap, scale, elements, (float *)output, count);
+
+			if (mtrx_calibration)
 			{
-				GPMF_CopyState(ms, &fs);
-				if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_ORIENTATION_IN, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
+				while (read_samples--)
 				{
-					orin_data = (char *)GPMF_RawData(&fs);
-					orin_len = GPMF_DATA_PACKEDSIZE(fs.buffer[fs.pos + 1]);
-				}
-				GPMF_CopyState(ms, &fs);
-				if (GPMF_OK == GPMF_FindPrev(&fs, GPMF_KEY_ORIENTATION_OUT, GPMF_CURRENT_LEVEL|GPMF_TOLERANT))
-				{
-					orio_data = (char *)GPMF_RawData(&fs);
-					orio_len = GPMF_DATA_PACKEDSIZE(fs.buffer[fs.pos + 1]);
-				}
-				if (orio_len == orin_len && orin_len > 1 && orio_len == elements)
-				{
-					uint32_t x, y, pos = 0;
-
-					mtrx_data = (uint32_t*)mtrx_buffer;
-					mtrx_type = outputType;
-
-					for (y = 0; y < elements; y++)
+					output += elements * output_sample_size;
+					switch (mtrx_type)
 					{
-						for (x = 0; x < elements; x++)
-						{
-							switch (mtrx_type)
-							{
-							case GPMF_TYPE_FLOAT:			MACRO_SET_MATRIX(float,       orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_DOUBLE:			MACRO_SET_MATRIX(double,      orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_SIGNED_BYTE:		MACRO_SET_MATRIX(int8_t,      orio_data[y], orin_data[x], pos);   break;
-							case GPMF_TYPE_UNSIGNED_BYTE:	MACRO_SET_MATRIX(uint8_t,     orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_SIGNED_SHORT:	MACRO_SET_MATRIX(int16_t,     orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_UNSIGNED_SHORT:  MACRO_SET_MATRIX(uint16_t,    orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_SIGNED_LONG:		MACRO_SET_MATRIX(int32_t,     orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_UNSIGNED_LONG:	MACRO_SET_MATRIX(uint32_t,    orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_SIGNED_64BIT_INT:  MACRO_SET_MATRIX(int64_t,   orio_data[y], orin_data[x], pos);  break;
-							case GPMF_TYPE_UNSIGNED_64BIT_INT: MACRO_SET_MATRIX(uint64_t, orio_data[y], orin_data[x], pos);  break;
-							default:
-								ret = GPMF_ERROR_SCALE_NOT_SUPPORTED;
-								goto cleanup;
-								break;
-							}
-
-							pos++;
-						}
+					case GPMF_TYPE_SIGNED_BYTE:  MACRO_APPLY_MATRIX_CALIBRATION(int8_t) break;
+					case GPMF_TYPE_UNSIGNED_BYTE:  MACRO_APPLY_MATRIX_CALIBRATION(uint8_t) break;
+					case GPMF_TYPE_SIGNED_SHORT:  MACRO_APPLY_MATRIX_CALIBRATION(int16_t) break;
+					case GPMF_TYPE_UNSIGNED_SHORT:  MACRO_APPLY_MATRIX_CALIBRATION(uint16_t) break;
+					case GPMF_TYPE_SIGNED_LONG:  MACRO_APPLY_MATRIX_CALIBRATION(int32_t) break;
+					case GPMF_TYPE_UNSIGNED_LONG:  MACRO_APPLY_MATRIX_CALIBRATION(uint32_t) break;
+					case GPMF_TYPE_FLOAT: MACRO_APPLY_MATRIX_CALIBRATION(float); break;
+					case GPMF_TYPE_DOUBLE: MACRO_APPLY_MATRIX_CALIBRATION(double); break;
+					default: break;
 					}
-
-					mtrx_calibration = 1;
 				}
 			}
+			goto cleanup;
 		}
 
-
 		while (read_samples--)
 		{
 			uint32_t i;
@@ -1882,9 +2348,8 @@ GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uin
 		}
 
 cleanup:
-		if(uncompressedSamples)
-			free(uncompressedSamples);
-
+		if (local_scratch.buffer)
+			free(local_scratch.buffer);
 		return ret;
 	}
 
@@ -1892,6 +2357,25 @@ cleanup:
 }
 
 
+GPMF_ERR GPMF_ScaledData(GPMF_stream *ms, void *buffer, uint32_t buffersize, uint32_t sample_offset, uint32_t read_samples, GPMF_SampleType outputType)
+{
+	uint32_t scaled = 0;
+
+	if (ms && ms->counters)
+	{
+		GPMF_counters *counters = ms->counters;
+		uint64_t start = CounterClock();
+		GPMF_ERR ret = ScaledData(ms, buffer, buffersize, sample_offset, read_samples, outputType, &scaled);
+
+		counters->scale_ns += CounterClock() - start;
+		if (ret == GPMF_OK)
+			counters->samples_scaled += scaled;
+		return ret;
+	}
+	return ScaledData(ms, buffer, buffersize, sample_offset, read_samples, outputType, &scaled);
+}
+
+
 
 GPMF_ERR GPMF_DecompressedSize(GPMF_stream *ms, uint32_t *neededsize)
 {
@@ -1905,369 +2389,537 @@ GPMF_ERR GPMF_DecompressedSize(GPMF_stream *ms, uint32_t *neededsize)
 }
 
 
-GPMF_ERR GPMF_Decompress(GPMF_stream *ms, uint32_t *localbuf, uint32_t localbuf_size)
+// Huffman codebook: 16-bit codebook plus the multi-symbol table. Built once on first use,
+// then shared read-only by every stream and thread.
+static struct
 {
-	if (ms && localbuf && localbuf_size)
-	{
-		if (ms->cbhandle == 0)
-			if (GPMF_OK != GPMF_AllocCodebook(&ms->cbhandle))
-				return GPMF_ERROR_MEMORY;
+	GPMF_codebook codes[65536];
+	GPMF_fastcode fast[1 << GPMF_FAST_BITS];
+} shared_codebook;
 
-		memset(localbuf, 0, localbuf_size); 
+#ifdef _WINDOWS
+static INIT_ONCE shared_codebook_once = INIT_ONCE_STATIC_INIT;
+#else
+static pthread_once_t shared_codebook_once = PTHREAD_ONCE_INIT;
+#endif
 
-		// unpack here
-		GPMF_SampleType type = (GPMF_SampleType)GPMF_SAMPLE_TYPE(ms->buffer[ms->pos + 2]);// The first 32-bit of data, is the uncomresseded type-size-repeat
-		uint8_t *start = (uint8_t *)&ms->buffer[ms->pos + 3];
-		uint16_t quant;
-		size_t sOffset = 0;
-		uint16_t *compressed_data;
-		uint32_t sample_size = GPMF_SAMPLE_SIZE(ms->buffer[ms->pos + 2]);
-		uint32_t sizeoftype = GPMF_SizeofType(type);
-		if(sizeoftype == 0) 
-			return GPMF_ERROR_MEMORY;
-		uint32_t chn = 0, channels = sample_size / sizeoftype;
-		uint32_t compressed_size = GPMF_DATA_PACKEDSIZE(ms->buffer[ms->pos + 1]);
-		uint32_t uncompressed_size = GPMF_DATA_PACKEDSIZE(ms->buffer[ms->pos + 2]);
+static const GPMF_codebook *SharedCodebook(void);
+
+
+// Bit reservoir: up to 64 bits, left aligned, refilled from the big-endian 16-bit words of the stream
+#define RESERVOIR_REFILL																\
+	if (count <= 32 && loaded + 2 <= words)												\
+	{																					\
+		bits |= (uint64_t)(((uint32_t)data[2 * loaded] << 24) | ((uint32_t)data[2 * loaded + 1] << 16) |	\
+			((uint32_t)data[2 * loaded + 2] << 8) | data[2 * loaded + 3]) << (32 - count);	\
+		loaded += 2;																	\
+		count += 32;																	\
+	}																					\
+	while (count <= 48 && loaded < words)												\
+	{																					\
+		bits |= (uint64_t)(((uint32_t)data[2 * loaded] << 8) | data[2 * loaded + 1]) << (48 - count);	\
+		loaded++;																		\
+		count += 16;																	\
+	}
 
-		if (sizeoftype == 0 && localbuf_size < uncompressed_size)
-			return GPMF_ERROR_MEMORY;
+#define RESERVOIR_CONSUME(n)	\
+	{							\
+		bits <<= (n);			\
+		count -= (int32_t)(n);	\
+		consumed += (n);		\
+	}
+
+// The reference decoder keeps the next 16-bit word loaded ahead, so it fails as soon as
+// that word would lie past the compressed data.
+#define RESERVOIR_CHECK			\
+	if (consumed / 16 + 1 >= words)	\
+		return GPMF_ERROR_MEMORY;
 
-		int signed_type = 1;
+#define COLUMN_SLACK	8	// spare column entries past the last sample
 
-		GPMF_codebook *cb = (GPMF_codebook *)ms->cbhandle;
 
-		if (sizeoftype == 4) // LONGs are handled at two channels of SHORTs
+/* Decodes one channel into 'column' (one entry per sample, sample 0 already holds the
+ * starting value). 'words' is the number of 16-bit words that may be read; on success
+ * 'words_used' is the length of the channel's bitstream, END code included.
+ * Output is bit-exact with the baseline decoder: a codeword's delta is added before its
+ * zero run is stored, so the run repeats the new value. */
+static GPMF_ERR DecodeChannel(const GPMF_codebook *cb, const GPMF_fastcode *fast, const uint8_t *data, uint32_t words,
+	uint32_t sizeoftype, uint32_t quant, uint32_t *column, uint32_t samples, uint32_t *words_used)
+{
+	uint64_t bits = 0;
+	int32_t count = 0;
+	uint32_t loaded = 0, consumed = 0;
+	uint32_t pos = 1;
+	uint32_t last = column[0];
+
+	while (1)
+	{
+		uint32_t window, zeros;
+		const GPMF_fastcode *fc;
+
+		RESERVOIR_REFILL
+		window = (uint32_t)(bits >> 48);
+
+		// common case: one lookup stores up to GPMF_FAST_SYMBOLS runs of zeros and values
+		fc = &fast[window >> (16 - GPMF_FAST_BITS)];
+		if (fc->count)
 		{
-			sizeoftype = 2;
-			channels *= 2;
+			uint32_t k, j;
+			for (k = 0; k < fc->count; k++)
+			{
+				zeros = fc->offset[k];
+				if (pos + zeros >= samples)
+					return GPMF_ERROR_MEMORY;
+
+				last += (uint32_t)((int32_t)fc->value[k] * (int32_t)quant);
+				if (zeros < COLUMN_SLACK) // short runs: fixed-size fill into the column slack, no data dependent loop
+				{
+					for (j = 0; j < COLUMN_SLACK; j++) column[pos + j] = last;
+					pos += zeros + 1;
+				}
+				else
+				{
+					while (zeros--) column[pos++] = last;
+					column[pos++] = last;
+				}
+			}
+			RESERVOIR_CONSUME(fc->bits_used)
+			RESERVOIR_CHECK
+			continue;
+		}
+
+		switch (cb[window].command)
+		{
+		case 0:  // store zeros and/or a value
+			zeros = cb[window].offset;
+			if (pos + zeros + (uint32_t)cb[window].bytes_stored > samples)
+				return GPMF_ERROR_MEMORY;
+
+			if (cb[window].bytes_stored)
+				last += (uint32_t)((int32_t)cb[window].value * (int32_t)quant);
+			while (zeros--) column[pos++] = last;
+			if (cb[window].bytes_stored)
+				column[pos++] = last;
+
+			RESERVOIR_CONSUME(cb[window].bits_used)
+			RESERVOIR_CHECK
+			break;
+
+		case 1: //channel END code detected, store the remaining zero deltas
+			while (pos < samples) column[pos++] = last;
+			*words_used = (consumed + 31) / 16;
+			return GPMF_OK;
+
+		case 2: //ESC code, next byte or short contains the delta.
+			RESERVOIR_CONSUME(16)
+			RESERVOIR_CHECK
+			RESERVOIR_REFILL
 
-			if (type == 'l')
-				type = GPMF_TYPE_SIGNED_SHORT;
+			if (pos >= samples)
+				return GPMF_ERROR_MEMORY;
+
+			window = (uint32_t)(bits >> 48);
+			if (sizeoftype == 2)
+				last += (uint32_t)((int32_t)(int16_t)window * (int32_t)quant);
 			else
-				type = GPMF_TYPE_UNSIGNED_SHORT; 
+				last += (uint32_t)((int32_t)(int8_t)(window >> 8) * (int32_t)quant);
+			column[pos++] = last;
+
+			RESERVOIR_CONSUME(8 * sizeoftype)
+			RESERVOIR_CHECK
+			break;
+
+		default: //Invalid codeword read
+			return GPMF_ERROR_MEMORY;
 		}
+	}
+}
+
 
+#define MACRO_STORE_COLUMN(outputcast, expr)							\
+{																		\
+	outputcast *out = (outputcast *)buffer + element;					\
+	for (s = 0; s < samples; s++, out += elements)						\
+	{																	\
+		uint32_t v = lo ? (column[s] << 16) | (lo[s] & 0xffff) : column[s];	\
+		*out = (outputcast)(expr);										\
+	}																	\
+}
+
+/* Writes one decoded element column into the interleaved output. 32-bit types are coded as
+ * two 16-bit channels: 'column' then holds the high halves and 'lo' the low halves. */
+static void StoreColumn(const uint32_t *column, const uint32_t *lo, uint32_t samples, void *buffer, uint32_t elements,
+	uint32_t element, GPMF_SampleType type, GPMF_SampleType outputType)
+{
+	uint32_t s;
+	uint32_t typesize = GPMF_SizeofType(type);
+
+	switch (outputType)
+	{
+	case GPMF_TYPE_DOUBLE:
+		switch (type)
+		{
+		case GPMF_TYPE_SIGNED_BYTE:		MACRO_STORE_COLUMN(double, (int8_t)v) break;
+		case GPMF_TYPE_UNSIGNED_BYTE:	MACRO_STORE_COLUMN(double, (uint8_t)v) break;
+		case GPMF_TYPE_SIGNED_SHORT:	MACRO_STORE_COLUMN(double, (int16_t)v) break;
+		case GPMF_TYPE_UNSIGNED_SHORT:	MACRO_STORE_COLUMN(double, (uint16_t)v) break;
+		case GPMF_TYPE_SIGNED_LONG:		MACRO_STORE_COLUMN(double, (int32_t)v) break;
+		case GPMF_TYPE_FLOAT:			MACRO_STORE_COLUMN(double, ((union { uint32_t u; float f; }){ v }).f) break;
+		default:						MACRO_STORE_COLUMN(double, v) break;
+		}
+		break;
+	case GPMF_TYPE_FLOAT:
+		switch (type)
+		{
+		case GPMF_TYPE_SIGNED_BYTE:		MACRO_STORE_COLUMN(float, (int8_t)v) break;
+		case GPMF_TYPE_UNSIGNED_BYTE:	MACRO_STORE_COLUMN(float, (uint8_t)v) break;
+		case GPMF_TYPE_SIGNED_SHORT:	MACRO_STORE_COLUMN(float, (int16_t)v) break;
+		case GPMF_TYPE_UNSIGNED_SHORT:	MACRO_STORE_COLUMN(float, (uint16_t)v) break;
+		case GPMF_TYPE_SIGNED_LONG:		MACRO_STORE_COLUMN(float, (int32_t)v) break;
+		case GPMF_TYPE_FLOAT:			MACRO_STORE_COLUMN(float, ((union { uint32_t u; float f; }){ v }).f) break;
+		default:						MACRO_STORE_COLUMN(float, v) break;
+		}
+		break;
+	case GPMF_TYPE_COMPRESSED: // big-endian, as in an uncompressed KLV
+		switch (typesize)
+		{
+		case 1:		MACRO_STORE_COLUMN(uint8_t, v) break;
+		case 2:		MACRO_STORE_COLUMN(uint16_t, BYTESWAP16(v)) break;
+		default:	MACRO_STORE_COLUMN(uint32_t, BYTESWAP32(v)) break;
+		}
+		break;
+	default: // native endian
+		switch (typesize)
+		{
+		case 1:		MACRO_STORE_COLUMN(uint8_t, v) break;
+		case 2:		MACRO_STORE_COLUMN(uint16_t, v) break;
+		default:	MACRO_STORE_COLUMN(uint32_t, v) break;
+		}
+		break;
+	}
+}
 
-		if (type == GPMF_TYPE_SIGNED_SHORT || type == GPMF_TYPE_SIGNED_BYTE)
-			signed_type = -1; //signed
 
+/* Huffman decoder for GPMF_TYPE_COMPRESSED KLVs. Each channel is a delta-coded bitstream; the
+ * bits are pulled from a 64-bit reservoir and short codes go through the GPMF_FAST_BITS
+ * multi-symbol table, falling back to the full 16-bit codebook for long codes, zero-only
+ * runs, escapes and the end code. 'outputType' GPMF_TYPE_COMPRESSED keeps the big-endian
+ * layout of GPMF_Decompress. */
+static GPMF_ERR DecodeCompressedKLV(GPMF_stream *ms, void *buffer, uint32_t buffersize, GPMF_SampleType outputType)
+{
+	if (GPMF_SAMPLE_TYPE(ms->buffer[ms->pos + 1]) != GPMF_TYPE_COMPRESSED ||
+		GPMF_OK != IsValidSize(ms, GPMF_DATA_SIZE(ms->buffer[ms->pos + 1]) >> 2))
+		return GPMF_ERROR_BAD_STRUCTURE;
 
-		uint16_t *buf_u16 = (uint16_t *)localbuf;
-		int16_t *buf_s16 = (int16_t *)localbuf;
-		uint8_t *buf_u8 = (uint8_t *)localbuf;
-		int8_t *buf_s8 = (int8_t *)localbuf;
-		int32_t last;
-		uint32_t pos, end = 0;
+	{
+		const GPMF_codebook *cb = SharedCodebook();
+		const GPMF_fastcode *fast = shared_codebook.fast;
+		GPMF_SampleType type = (GPMF_SampleType)GPMF_SAMPLE_TYPE(ms->buffer[ms->pos + 2]); // The first 32-bit of data, is the uncompressed type-size-repeat
+		uint8_t *start = (uint8_t *)&ms->buffer[ms->pos + 3];
+		uint32_t sample_size = GPMF_SAMPLE_SIZE(ms->buffer[ms->pos + 2]);
+		uint32_t samples = GPMF_SAMPLES(ms->buffer[ms->pos + 2]);
+		uint32_t compressed_size = GPMF_DATA_PACKEDSIZE(ms->buffer[ms->pos + 1]);
+		uint32_t typesize = GPMF_SizeofType(type);
+		uint32_t sizeoftype = typesize == 4 ? 2 : typesize; // LONGs are handled at two channels of SHORTs
+		uint32_t elements, channels, outputsize, chn;
+		uint32_t localcolumns[2048];
+		uint32_t *columns = localcolumns;
+		size_t sOffset = sample_size;
+		GPMF_ERR ret = GPMF_OK;
 
-		if(sample_size > compressed_size)
+		if (sizeoftype != 1 && sizeoftype != 2)
+			return GPMF_ERROR_TYPE_NOT_SUPPORTED;
+		if (sample_size == 0 || sample_size % typesize || samples == 0 || sample_size > compressed_size)
 			return GPMF_ERROR_MEMORY;
-			
-		memcpy(&buf_u8[0], start, sample_size);
 
-		sOffset += sample_size;
+		elements = sample_size / typesize;
+		channels = sample_size / sizeoftype;
 
-		for (chn = 0; chn<channels; chn++)
+		switch (outputType)
 		{
-			pos = 1;
+		case GPMF_TYPE_DOUBLE:	outputsize = samples * elements * 8; break;
+		case GPMF_TYPE_FLOAT:	outputsize = samples * elements * 4; break;
+		default:				outputsize = samples * sample_size; break;
+		}
+		if (outputsize > buffersize)
+			return GPMF_ERROR_MEMORY;
+
+		if (outputType == GPMF_TYPE_COMPRESSED)
+			memset(buffer, 0, buffersize);
 
-			if (sOffset >= localbuf_size)
+		if ((samples + COLUMN_SLACK) * 2 > sizeof(localcolumns) / sizeof(uint32_t))
+		{
+			columns = (uint32_t *)malloc((size_t)(samples + COLUMN_SLACK) * 2 * sizeof(uint32_t));
+			if (columns == NULL)
 				return GPMF_ERROR_MEMORY;
+			if (ms->counters)
+				ms->counters->allocations++;
+		}
+
+		for (chn = 0; chn < channels; chn++)
+		{
+			uint32_t *column = &columns[(typesize == 4 && (chn & 1)) ? samples + COLUMN_SLACK : 0];
+			uint32_t quant, words, words_used = 0;
 
-			switch ((int)sizeoftype * signed_type)
+			// the first sample is stored uncompressed
+			if (sizeoftype == 2)
 			{
-			default:
-			case -2: last = BYTESWAP16(buf_s16[chn]); quant = *((uint16_t *)&start[sOffset]); quant = BYTESWAP16(quant); sOffset += 2; break;
-			case -1: last = (int8_t)buf_s8[chn]; quant = *((uint8_t *)&start[sOffset]); sOffset++; break;
-			case 1: last = buf_u8[chn]; quant = *((uint8_t *)&start[sOffset]); sOffset++; break;
-			case 2: last = BYTESWAP16(buf_u16[chn]); quant = *((uint16_t *)&start[sOffset]); quant = BYTESWAP16(quant); sOffset += 2;  break;
+				column[0] = ((uint32_t)start[chn * 2] << 8) | start[chn * 2 + 1];
+				quant = ((uint32_t)start[sOffset] << 8) | start[sOffset + 1];
+				sOffset += 2;
+			}
+			else
+			{
+				column[0] = type == GPMF_TYPE_SIGNED_BYTE ? (uint32_t)(int32_t)(int8_t)start[chn] : start[chn];
+				quant = start[sOffset];
+				sOffset++;
 			}
-						
-			sOffset = ((sOffset + 1) & (uint32_t)~1); //16-bit aligned compressed data
+
+			sOffset = ((sOffset + 1) & ~(size_t)1); //16-bit aligned compressed data
 
 			if (sOffset >= compressed_size)
-				return GPMF_ERROR_MEMORY;
+			{
+				ret = GPMF_ERROR_MEMORY;
+				break;
+			}
 
-			compressed_data = (uint16_t *)&start[sOffset];
+			// words within the payload, the first two are always read
+			words = (uint32_t)(compressed_size - sOffset + 1) / 2;
+			if (words < 2) words = 2;
 
-			uint16_t currWord = BYTESWAP16(*compressed_data); compressed_data++;
-			uint16_t nextWord = BYTESWAP16(*compressed_data); compressed_data++;
-			int currBits = 16;
-			int nextBits = 16;
+			ret = DecodeChannel(cb, fast, start + sOffset, words, sizeoftype, quant, column, samples, &words_used);
+			if (ret != GPMF_OK)
+				break;
+			sOffset += words_used * 2;
 
-			do
-			{
-				switch (cb[currWord].command)
-				{
-				case 0:  // store zeros and/or a value
-					{
-						int usedbits = cb[currWord].bits_used;
-						uint32_t zeros = cb[currWord].offset;
-						int delta = (int)cb[currWord].value * quant;
+			if (typesize != 4)
+				StoreColumn(column, NULL, samples, buffer, elements, chn, type, outputType);
+			else if (chn & 1)
+				StoreColumn(columns, column, samples, buffer, elements, chn >> 1, type, outputType);
+		}
 
-						last += delta * cb[currWord].bytes_stored;
+		if (columns != localcolumns)
+			free(columns);
 
-						if (channels * (pos + zeros) * sizeoftype > localbuf_size) 
-							return GPMF_ERROR_MEMORY;
+		return ret;
+	}
+}
 
-						switch ((int)sizeoftype * signed_type)
-						{
-						default:
-						case -2:
-							while (zeros) { buf_s16[channels*pos++ + chn] = (int16_t) BYTESWAP16(last); zeros--; }
-							buf_s16[channels*pos + chn] = (int16_t) BYTESWAP16(last);
-							break;
-						case -1:
-							while (zeros) { buf_s8[channels*pos++ + chn] = (int8_t)last; zeros--; }
-							buf_s8[channels*pos + chn] = (int8_t)last;
-							break;
-						case 1:
-							while (zeros) { buf_u8[channels*pos++ + chn] = (uint8_t)last; zeros--; }
-							buf_u8[channels*pos + chn] = (uint8_t)last;
-							break;
-						case 2:
-							while (zeros) { buf_u16[channels*pos++ + chn] = BYTESWAP16(last); zeros--; }
-							buf_u16[channels*pos + chn] = BYTESWAP16(last);
-							break;
-						}
-										
-						pos += (uint32_t) cb[currWord].bytes_stored;
-						currWord <<= usedbits;
-						currBits -= usedbits;
-					}
-					break;
 
-				case 1: //channel END code detected, store the remaining zero deltas
-					{
-						int zeros = (int)(uncompressed_size/(channels*sizeoftype) - pos);
+static GPMF_ERR DecompressKLV(GPMF_stream *ms, void *buffer, uint32_t buffersize, GPMF_SampleType outputType)
+{
+	if (ms->counters)
+	{
+		GPMF_counters *counters = ms->counters;
+		uint64_t start = CounterClock();
+		GPMF_ERR ret = DecodeCompressedKLV(ms, buffer, buffersize, outputType);
 
-						if (channels * (pos + zeros) * sizeoftype > localbuf_size)
-							return GPMF_ERROR_MEMORY;
+		counters->decompress_ns += CounterClock() - start;
+		if (ret == GPMF_OK)
+		{
+			counters->compressed_klvs++;
+			counters->compressed_bytes += GPMF_DATA_PACKEDSIZE(ms->buffer[ms->pos + 1]);
+		}
+		return ret;
+	}
+	return DecodeCompressedKLV(ms, buffer, buffersize, outputType);
+}
 
-						switch ((int)sizeoftype*signed_type)
-						{
-						default:
-						case -2:
-							while (zeros) { buf_s16[channels*pos++ + chn] = (int16_t) BYTESWAP16(last); zeros--; }
-							break;
-						case -1:
-							while (zeros) { buf_s8[channels*pos++ + chn] = (int8_t)last; zeros--; }
-							break;
-						case 1:
-							while (zeros) { buf_u8[channels*pos++ + chn] = (uint8_t)last; zeros--; }
-							break;
-						case 2:
-							while (zeros) { buf_u16[channels*pos++ + chn] = (uint16_t) BYTESWAP16(last); zeros--; }
-							break;
-						}
-					}
-					end = 1;
-					break;
 
-				case 2: //ESC code, next byte or short contains the delta.
-					{
-						int usedbits = cb[currWord].bits_used;
-						int delta;
-						currWord <<= usedbits;
-						currBits -= usedbits;
+GPMF_ERR GPMF_Decompress(GPMF_stream *ms, uint32_t *localbuf, uint32_t localbuf_size)
+{
+	if (ms && localbuf && localbuf_size)
+		return DecompressKLV(ms, localbuf, localbuf_size, GPMF_TYPE_COMPRESSED);
 
-						//Get more bits
-						while (currBits < 16)
-						{
-							int needed = 16 - currBits;
-							currWord |= nextWord >> currBits;
-							if (nextBits >= needed) currBits = 16; else currBits += nextBits;	
-							nextWord <<= needed;
-							nextBits -= needed;
-							if (nextBits <= 0)
-							{
-								if(((size_t)compressed_data - (size_t)start) >= compressed_size)
-									return GPMF_ERROR_MEMORY;
-								nextWord = BYTESWAP16(*compressed_data);
-								compressed_data++;
-								nextBits = 16;
-							}
-						}
+	return GPMF_ERROR_MEMORY;
+}
 
-						if((channels * pos * sizeoftype) >= localbuf_size)
-							return GPMF_ERROR_MEMORY;
-						
-						switch ((int)sizeoftype*signed_type)
-						{
-						default:
-						case -2:
-							delta = (int16_t)(currWord);
-							delta *= quant;
-							last += delta;
-							buf_s16[channels*pos++ + chn] = (int16_t) BYTESWAP16(last);
-							break;
-						case -1:
-							delta = (int8_t)(currWord >> 8);
-							delta *= quant;
-							last += delta;
-							buf_s8[channels*pos++ + chn] = (int8_t)last;
-							break;
-						case 1: 
-							delta = (int8_t)(currWord >> 8);
-							delta *= quant;
-							last += delta;
-							buf_u8[channels*pos++ + chn] = (uint8_t)last;
-							break;
-						case 2:
-							delta = (int16_t)(currWord);
-							delta *= quant;
-							last += delta;
-							buf_u16[channels*pos++ + chn] = BYTESWAP16(last);
-							break;
-						}
-						currWord <<= 8 * sizeoftype;
-						currBits -= 8 * sizeoftype;
-					}
-					break;
 
-				default: //Invalid codeword read
-					end = 1; 
-					return GPMF_ERROR_MEMORY;
-					break;
-				}
+GPMF_ERR GPMF_DecompressTo(GPMF_stream *ms, void *buffer, uint32_t buffersize, GPMF_SampleType outputType)
+{
+	if (ms && buffer && buffersize)
+	{
+		GPMF_SampleType type = GPMF_Type(ms);
 
-				//Get more bits
-				while (currBits < 16)
-				{
-					int needed = 16 - currBits;
-					currWord |= nextWord >> currBits;
-					if (nextBits >= needed) currBits = 16; else currBits += nextBits;
-					nextWord <<= needed;
-					nextBits -= needed;
-					if (nextBits <= 0)
-					{
-						if (((size_t)compressed_data - (size_t)start) >= compressed_size)
-							return GPMF_ERROR_MEMORY;
-						nextWord = BYTESWAP16(*compressed_data);
-						compressed_data++;
-						nextBits = 16;
-					}
-				}
-			} while (!end);
-			
-			if (nextBits == 16) compressed_data--;
-			sOffset = (size_t)compressed_data - (size_t)start;
-			end = 0;
+		if (outputType == GPMF_TYPE_DOUBLE || outputType == GPMF_TYPE_FLOAT)
+		{
+			switch (type)
+			{
+			case GPMF_TYPE_SIGNED_BYTE:
+			case GPMF_TYPE_UNSIGNED_BYTE:
+			case GPMF_TYPE_SIGNED_SHORT:
+			case GPMF_TYPE_UNSIGNED_SHORT:
+			case GPMF_TYPE_SIGNED_LONG:
+			case GPMF_TYPE_UNSIGNED_LONG:
+			case GPMF_TYPE_FLOAT:
+				break;
+			default:
+				return GPMF_ERROR_TYPE_NOT_SUPPORTED;
+			}
 		}
+		else if (outputType != type)
+			return GPMF_ERROR_TYPE_NOT_SUPPORTED;
 
-		return GPMF_OK;
+		return DecompressKLV(ms, buffer, buffersize, outputType);
 	}
 
 	return GPMF_ERROR_MEMORY;
 }
 
 
-GPMF_ERR GPMF_AllocCodebook(size_t *cbhandle)
+static void BuildCodebookEntry(uint16_t code, GPMF_codebook *cb)
 {
-	*cbhandle = (size_t)malloc(65536 * sizeof(GPMF_codebook));
-	if (*cbhandle)
+	uint16_t mask = 0x8000;
+	int v, z, zeros = 0, used = 0;
+
+	cb->command = 0;
+	cb->value = 0;
+
+	// all commands are 16-bits long
+	if (code == enccontrolcodestable.entries[HUFF_ESC_CODE_ENTRY].bits)
+	{
+		cb->command = 2;
+		cb->bytes_stored = 1;
+		cb->bits_used = 16;
+		cb->offset = 0;
+		return;
+	}
+	if (code == enccontrolcodestable.entries[HUFF_END_CODE_ENTRY].bits)
 	{
-		int i,v,z;
-		GPMF_codebook *cb = (GPMF_codebook *)*cbhandle;
+		cb->command = 1;
+		cb->bytes_stored = 0;
+		cb->bits_used = 16;
+		cb->offset = 0;
+		return;
+	}
 
-		for (i = 0; i <= 0xffff; i++)
+	for (z = enczerorunstable.length-1; z >= 0; z--)
+	{
+		if (16 - used >= enczerorunstable.entries[z].size)
 		{
-			uint16_t code = (uint16_t)i;
-			uint16_t mask = 0x8000;
-			int zeros = 0, used = 0;
-
-			cb->command = 0;
-			
-			// all commands are 16-bits long
-			if (code == enccontrolcodestable.entries[HUFF_ESC_CODE_ENTRY].bits)
-			{
-				cb->command = 2;
-				cb->bytes_stored = 1;
-				cb->bits_used = 16;
-				cb->offset = 0;
-				cb++;
-				continue;
-			}
-			if (code == enccontrolcodestable.entries[HUFF_END_CODE_ENTRY].bits)
+			if ((code >> (16 - enczerorunstable.entries[z].size)) == enczerorunstable.entries[z].bits)
 			{
-				cb->command = 1;
-				cb->bytes_stored = 0;
-				cb->bits_used = 16;
-				cb->offset = 0;
-				cb++;
-				continue;
-			}
-			
-			for (z = enczerorunstable.length-1; z >= 0; z--)
-			{
-				if (16 - used >= enczerorunstable.entries[z].size)
-				{
-					if ((code >> (16 - enczerorunstable.entries[z].size)) == enczerorunstable.entries[z].bits)
-					{
-						zeros += enczerorunstable.entries[z].count;
-						used  += enczerorunstable.entries[z].size;
-						mask >>= enczerorunstable.entries[z].size;
-						break;
-					}
-				}
-				else break;
+				zeros += enczerorunstable.entries[z].count;
+				used  += enczerorunstable.entries[z].size;
+				mask >>= enczerorunstable.entries[z].size;
+				break;
 			}
+		}
+		else break;
+	}
 
-			// count single zeros.
-			while (!(code & mask) && mask)
-			{
-				zeros++;
-				used++;
-				mask >>= 1;
-			}
+	// count single zeros.
+	while (!(code & mask) && mask)
+	{
+		zeros++;
+		used++;
+		mask >>= 1;
+	}
 
-			//move the code word up to see if is a complete code for a value following the zeros.  
-			code <<= used;
+	//move the code word up to see if is a complete code for a value following the zeros.
+	code = (uint16_t)((uint32_t)code << used);
 
-			cb->bytes_stored = 0;
-			for (v=enchuftable.length-1; v>0; v--)
-			{
-				if (16-used >= enchuftable.entries[v].size+1) // codeword + sign bit
-				{
-					if ((code >> (16 - enchuftable.entries[v].size)) == enchuftable.entries[v].bits)
-					{
-						int sign = 1-(((code >> (16 - (enchuftable.entries[v].size + 1))) & 1)<<1); // last bit is the sign.
-						cb->value = enchuftable.entries[v].value * (int16_t)sign;
-						used += enchuftable.entries[v].size+1;
-						cb->bytes_stored = 1;
-						break;
-					}
-				}
-			}
-			
-			if (used == 0)
+	cb->bytes_stored = 0;
+	for (v=enchuftable.length-1; v>0; v--)
+	{
+		if (16-used >= enchuftable.entries[v].size+1) // codeword + sign bit
+		{
+			if ((code >> (16 - enchuftable.entries[v].size)) == enchuftable.entries[v].bits)
 			{
-				used = 16;
-				cb->command = -1; // ERROR invalid code
+				int sign = 1-(((code >> (16 - (enchuftable.entries[v].size + 1))) & 1)<<1); // last bit is the sign.
+				cb->value = enchuftable.entries[v].value * (int16_t)sign;
+				used += enchuftable.entries[v].size+1;
+				cb->bytes_stored = 1;
+				break;
 			}
-			cb->bits_used = (uint8_t)used;
-			cb->offset = (uint8_t)zeros;
-			cb++;
 		}
-
-		return GPMF_OK;
 	}
 
-	return GPMF_ERROR_MEMORY;
+	if (used == 0)
+	{
+		used = 16;
+		cb->command = -1; // ERROR invalid code
+	}
+	cb->bits_used = (uint8_t)used;
+	cb->offset = (uint8_t)zeros;
 }
 
-GPMF_ERR GPMF_FreeCodebook(size_t cbhandle)
+
+/* Multi-symbol entries: a 16-bit codebook entry is only certain from the first GPMF_FAST_BITS
+ * bits when it ends with a value inside them (every code is prefix free). Following symbols
+ * are packed the same way, from the bits left after the previous one. */
+static void BuildFastEntry(uint32_t index, GPMF_fastcode *fc)
 {
-	GPMF_codebook *cb = (GPMF_codebook *)cbhandle;
+	uint32_t known = GPMF_FAST_BITS;
+	uint32_t window = index << (16 - GPMF_FAST_BITS);
+
+	fc->count = 0;
+	fc->bits_used = 0;
 
-	if (cb)
+	while (fc->count < GPMF_FAST_SYMBOLS)
 	{
-		free(cb);
+		GPMF_codebook entry;
+		BuildCodebookEntry((uint16_t)(window << fc->bits_used), &entry);
+
+		if (entry.command != 0 || entry.bytes_stored != 1 || entry.bits_used > known - fc->bits_used)
+			break;
+
+		fc->offset[fc->count] = entry.offset;
+		fc->value[fc->count] = (int8_t)entry.value;
+		fc->bits_used += entry.bits_used;
+		fc->count++;
+	}
+}
+
+
+static void BuildSharedCodebook(void)
+{
+	uint32_t i;
+
+	for (i = 0; i <= 0xffff; i++)
+		BuildCodebookEntry((uint16_t)i, &shared_codebook.codes[i]);
+
+	for (i = 0; i < (1 << GPMF_FAST_BITS); i++)
+		BuildFastEntry(i, &shared_codebook.fast[i]);
+}
 
+#ifdef _WINDOWS
+static BOOL CALLBACK BuildSharedCodebookOnce(PINIT_ONCE once, PVOID parameter, PVOID *context)
+{
+	BuildSharedCodebook();
+	return TRUE;
+}
+#endif
+
+static const GPMF_codebook *SharedCodebook(void)
+{
+#ifdef _WINDOWS
+	InitOnceExecuteOnce(&shared_codebook_once, BuildSharedCodebookOnce, NULL, NULL);
+#else
+	pthread_once(&shared_codebook_once, BuildSharedCodebook);
+#endif
+	return shared_codebook.codes;
+}
+
+
+// Kept for API compatibility: every handle is the shared, read-only codebook.
+GPMF_ERR GPMF_AllocCodebook(size_t *cbhandle)
+{
+	if (cbhandle)
+	{
+		*cbhandle = (size_t)SharedCodebook();
 		return GPMF_OK;
 	}
+
 	return GPMF_ERROR_MEMORY;
 }
 
+GPMF_ERR GPMF_FreeCodebook(size_t cbhandle)
+{
+	// the shared codebook lives for the whole process
+	return cbhandle ? GPMF_OK : GPMF_ERROR_MEMORY;
+}
+
 GPMF_ERR GPMF_Free(GPMF_stream* ms)
 {
 	if (ms)
@@ -32,6 +32,55 @@ extern "C" {
 
 #define GPMF_NEST_LIMIT 16
 
+#define GPMF_CALIBRATION_ENTRIES	8	// streams a calibration cache remembers
+#define GPMF_CALIBRATION_RAW_LONGS	160	// SCAL, MTRX, ORIN and ORIO KLVs (headers included) an entry can be keyed on
+#define GPMF_CALIBRATION_TYPE_LONGS	18	// TYPE KLV (header included) the cached complex type can be keyed on
+
+typedef struct GPMF_calibration
+{
+	uint32_t valid;
+	uint32_t elements;
+	uint32_t outputType;
+	uint32_t raw_longs;							// calibration KLVs the entry was resolved from
+	uint32_t raw[GPMF_CALIBRATION_RAW_LONGS];
+	uint8_t scal_type;
+	uint8_t scal_count;
+	uint8_t mtrx_type;
+	uint8_t mtrx_calibration;					// MTRX, or ORIN/ORIO expanded to a matrix of outputType
+	uint32_t scal_typesize;
+	uint64_t scal[32];							// native endian, 8-byte aligned for 'd'/'J' scales
+	uint64_t mtrx[32];							// native endian, 8-byte aligned for double matrices
+} GPMF_calibration;
+
+typedef struct GPMF_calibration_cache
+{
+	GPMF_calibration entry[GPMF_CALIBRATION_ENTRIES];
+	uint32_t next;								// entry replaced on the next miss
+	uint32_t type_longs;						// TYPE KLV the expansion below came from, 0 when empty
+	uint32_t type_raw[GPMF_CALIBRATION_TYPE_LONGS];
+	char complextype[64];
+	uint32_t complextype_length;
+} GPMF_calibration_cache;
+
+typedef struct GPMF_scratch
+{
+	uint32_t *buffer;							// decompressed samples of the last '#' KLV scaled with this scratch
+	uint32_t size;								// bytes allocated at buffer
+	uint32_t pos;								// pos + 1 of the KLV held in buffer, 0 when empty
+	uint32_t *source;							// stream buffer 'pos' refers to
+} GPMF_scratch;
+
+typedef struct GPMF_counters
+{
+	uint64_t klv_steps;							// KLVs stepped over by GPMF_Next
+	uint64_t compressed_klvs;					// '#' KLVs decoded
+	uint64_t compressed_bytes;					// '#' payload bytes decoded
+	uint64_t samples_scaled;					// samples written by successful GPMF_ScaledData calls (requests past the end of a '#' KLV are clamped)
+	uint64_t allocations;						// decompression caches and oversized decoder columns allocated
+	uint64_t decompress_ns;						// time decoding '#' KLVs
+	uint64_t scale_ns;							// time in GPMF_ScaledData, decompression included
+} GPMF_counters;
+
 typedef struct GPMF_stream
 {
 	uint32_t *buffer;
@@ -44,11 +93,41 @@ typedef struct GPMF_stream
 	uint32_t device_count;
 	uint32_t device_id;
 	char device_name[32];
-	size_t cbhandle; // compression handler
+	size_t cbhandle; // compression handler (unused, compressed streams share one process-wide codebook)
+	GPMF_scratch *scratch; // optional, caller owned, shared by copies (see GPMF_SetScratch)
+	GPMF_calibration_cache *calibration; // optional, caller owned, shared by copies (see GPMF_SetCalibrationCache)
+	GPMF_counters *counters; // optional, caller owned, shared by copies (see GPMF_SetCounters)
 } GPMF_stream;
 
 
 
+#define GPMF_INDEX_ENTRIES	64	// STRMs a payload index records
+#define GPMF_INDEX_LEVELS	4	// deepest nest level of an indexed samples KLV, plus one
+#define GPMF_INDEX_SLOTS	128	// hash slots, a power of two above twice GPMF_INDEX_ENTRIES
+
+typedef struct GPMF_index_entry
+{
+	uint32_t device_id;							// DVID of the DEVC holding the STRM
+	uint32_t key;								// FourCC of the samples
+	uint32_t pos;								// stream state at the samples KLV, as left by GPMF_SeekToSamples()
+	uint32_t nest_level;
+	uint32_t device_count;
+	uint32_t last_level_pos[GPMF_INDEX_LEVELS];
+	uint32_t nest_size[GPMF_INDEX_LEVELS];
+	uint32_t last_seek[GPMF_INDEX_LEVELS];
+	char device_name[32];
+} GPMF_index_entry;
+
+typedef struct GPMF_index
+{
+	uint32_t *buffer;							// payload the index was built for
+	uint32_t count;
+	uint32_t complete;							// 0 when some STRM did not fit (too many, or nested GPMF_INDEX_LEVELS deep)
+	GPMF_index_entry entry[GPMF_INDEX_ENTRIES];	// in file order
+	uint8_t slot[GPMF_INDEX_SLOTS];				// entry + 1 by (device_id, key), 0 when empty
+} GPMF_index;
+
+
 typedef enum GPMF_LEVELS
 {
 	GPMF_CURRENT_LEVEL = 0,  // search or validate within the current GPMF next level
@@ -61,7 +140,11 @@ typedef enum GPMF_LEVELS
 // Prepare GPMF data 
 GPMF_ERR GPMF_Init(GPMF_stream *gs, uint32_t *buffer, uint32_t datasize);							//Initialize a GPMF_stream for parsing a particular buffer.
 GPMF_ERR GPMF_ResetState(GPMF_stream *gs);														//Read from beginning of the buffer again
-GPMF_ERR GPMF_CopyState(GPMF_stream *src, GPMF_stream *dst);									//Copy state, 
+GPMF_ERR GPMF_CopyState(GPMF_stream *src, GPMF_stream *dst);									//Copy state, attached caches and counters are shared with the copy
+GPMF_ERR GPMF_SetCalibrationCache(GPMF_stream *gs, GPMF_calibration_cache *cache);			//Reuse SCAL/MTRX/ORIN/ORIO/TYPE resolved by GPMF_ScaledData while their bytes match, e.g. across payloads. The cache starts zeroed, one per thread, NULL to detach. Attach again after GPMF_Init().
+GPMF_ERR GPMF_SetScratch(GPMF_stream *gs, GPMF_scratch *scratch);								//Decompress '#' KLVs in GPMF_ScaledData into 'scratch', growing it only when a KLV is larger than any before, e.g. across STRMs and payloads. The scratch starts zeroed, one per thread, released by GPMF_FreeScratch(). Without one every compressed read allocates and frees. Attaching drops what the scratch held, attach again after GPMF_Init().
+GPMF_ERR GPMF_FreeScratch(GPMF_scratch *scratch);
+GPMF_ERR GPMF_SetCounters(GPMF_stream *gs, GPMF_counters *counters);							//Add KLV steps, decompression and scaling work to 'counters' (opt-in profiling, nothing is counted or timed without it). Not atomic, one per thread, NULL to detach. Attach again after GPMF_Init().
 GPMF_ERR GPMF_Validate(GPMF_stream *gs, GPMF_LEVELS recurse);									//Is the nest structure valid GPMF? 
 
 // Navigate through GPMF data 
@@ -69,6 +152,9 @@ GPMF_ERR GPMF_Next(GPMF_stream *gs, GPMF_LEVELS recurse);										//Step to the
 GPMF_ERR GPMF_FindPrev(GPMF_stream *gs, uint32_t fourCC, GPMF_LEVELS recurse);					//find a previous FourCC -- at the current level only if recurse is false
 GPMF_ERR GPMF_FindNext(GPMF_stream *gs, uint32_t fourCC, GPMF_LEVELS recurse);					//find a particular FourCC upcoming -- at the current level only if recurse is false
 GPMF_ERR GPMF_SeekToSamples(GPMF_stream *gs);													//find the last FourCC in the current level, this is raw data for any STRM
+GPMF_ERR GPMF_BuildIndex(GPMF_stream *gs, GPMF_index *index);									//one pass over the payload, recording where the samples of every STRM start by DVID and FourCC; GPMF_ERROR_MEMORY when index->complete is 0
+GPMF_ERR GPMF_FindIndexed(GPMF_stream *gs, GPMF_index *index, uint32_t device_id, uint32_t fourCC);	//O(1) lookup, leaves gs on the samples as GPMF_FindNext(STRM) + GPMF_SeekToSamples() would; walks the payload for STRMs an incomplete index missed
+GPMF_ERR GPMF_SeekToIndexed(GPMF_stream *gs, GPMF_index *index, uint32_t n);					//same for the n-th indexed STRM, in file order (an incomplete index lacks some, walk with GPMF_FindNext instead)
 
 // Get information about the current GPMF KLV
 uint32_t GPMF_Key(GPMF_stream *gs);																//return the current Key (FourCC)
@@ -112,11 +198,23 @@ typedef struct GPMF_codebook
 	int8_t command;		//0 - OKAY,  -1 valid code, 1 - end
 } GPMF_codebook;
 
+#define GPMF_FAST_BITS		12	// lookup width of the multi-symbol table
+#define GPMF_FAST_SYMBOLS	3	// most symbols decoded by one lookup
+
+typedef struct GPMF_fastcode
+{
+	uint8_t count;						//symbols decoded by this entry, 0 - use the 16-bit codebook
+	uint8_t bits_used;					//bits consumed by all the symbols
+	uint8_t offset[GPMF_FAST_SYMBOLS];	//zeros to store before each value
+	int8_t value[GPMF_FAST_SYMBOLS];	//value of each symbol
+} GPMF_fastcode;
+
 
-GPMF_ERR GPMF_AllocCodebook(size_t *cbhandle);
+GPMF_ERR GPMF_AllocCodebook(size_t *cbhandle);	// returns the shared codebook, nothing is allocated
 GPMF_ERR GPMF_FreeCodebook(size_t cbhandle);
 GPMF_ERR GPMF_DecompressedSize(GPMF_stream *gs, uint32_t *neededsize);
-GPMF_ERR GPMF_Decompress(GPMF_stream *gs, uint32_t *localbuf, uint32_t localbuf_size);
+GPMF_ERR GPMF_Decompress(GPMF_stream *gs, uint32_t *localbuf, uint32_t localbuf_size);	// big-endian, as stored in an uncompressed KLV
+GPMF_ERR GPMF_DecompressTo(GPMF_stream *gs, void *buffer, uint32_t buffersize, GPMF_SampleType outputType); // native endian for the stored type, or unscaled GPMF_TYPE_DOUBLE/GPMF_TYPE_FLOAT
 GPMF_ERR GPMF_Free(GPMF_stream* gs); 
 
 
@@ -0,0 +1,391 @@
+/*! @file GPMF_simd.c
+ *
+ *  @brief Vectorized byte-swap, convert and scale kernels used by GPMF_ScaledData
+ *
+ *  Every kernel works on runs of 8 values. The scale vector is tiled over
+ *  8 samples (8 * elements values), so each run lines up with its scales no
+ *  matter how many elements a sample has.
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "GPMF_simd.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define GPMF_SIMD_AVX2	1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GPMF_SIMD_SSE2	1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GPMF_SIMD_NEON	1
+#endif
+
+#define GPMF_SIMD_RUN		8	// values per vector step
+#define GPMF_SIMD_TILE		(GPMF_SIMD_MAX_ELEMENTS * GPMF_SIMD_RUN)
+
+
+static uint32_t InputTypeSize(GPMF_SampleType type)
+{
+	switch (type)
+	{
+	case GPMF_TYPE_SIGNED_SHORT:
+	case GPMF_TYPE_UNSIGNED_SHORT:
+		return 2;
+	case GPMF_TYPE_SIGNED_LONG:
+	case GPMF_TYPE_UNSIGNED_LONG:
+	case GPMF_TYPE_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+
+uint32_t GPMF_SIMD_Supported(GPMF_SampleType inputType, GPMF_SampleType outputType, uint32_t elements)
+{
+	if (elements == 0 || elements > GPMF_SIMD_MAX_ELEMENTS)
+		return 0;
+	if (outputType != GPMF_TYPE_DOUBLE && outputType != GPMF_TYPE_FLOAT)
+		return 0;
+	return InputTypeSize(inputType) != 0;
+}
+
+
+// Scalar reference, also used for run tails. Every supported input is exact in a double,
+// so (float)ReadValue() rounds exactly like the direct (float) cast of the generic path.
+static double ReadValue(const uint8_t *src, GPMF_SampleType type, uint32_t swap)
+{
+	switch (type)
+	{
+	case GPMF_TYPE_SIGNED_SHORT:
+	case GPMF_TYPE_UNSIGNED_SHORT:
+	{
+		uint16_t v;
+		memcpy(&v, src, 2);
+		if (swap) v = (uint16_t)BYTESWAP16(v);
+		return type == GPMF_TYPE_SIGNED_SHORT ? (double)(int16_t)v : (double)v;
+	}
+	case GPMF_TYPE_SIGNED_LONG:
+	case GPMF_TYPE_UNSIGNED_LONG:
+	case GPMF_TYPE_FLOAT:
+	{
+		uint32_t v;
+		memcpy(&v, src, 4);
+		if (swap) v = BYTESWAP32(v);
+		if (type == GPMF_TYPE_FLOAT)
+		{
+			float f;
+			memcpy(&f, &v, 4);
+			return (double)f;
+		}
+		return type == GPMF_TYPE_SIGNED_LONG ? (double)(int32_t)v : (double)v;
+	}
+	default:
+		return 0.0;
+	}
+}
+
+
+#if GPMF_SIMD_AVX2
+
+static const uint8_t swap16_mask[16] = { 1,0, 3,2, 5,4, 7,6, 9,8, 11,10, 13,12, 15,14 };
+static const uint8_t swap32_mask[32] = { 3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+										 3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12 };
+
+// 8 integer values widened to int32 lanes (raw bits for floats)
+static inline __m256i Load8(const uint8_t *src, GPMF_SampleType type, uint32_t swap)
+{
+	if (InputTypeSize(type) == 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		if (swap) v = _mm_shuffle_epi8(v, _mm_loadu_si128((const __m128i *)swap16_mask));
+		return type == GPMF_TYPE_SIGNED_SHORT ? _mm256_cvtepi16_epi32(v) : _mm256_cvtepu16_epi32(v);
+	}
+	else
+	{
+		__m256i v = _mm256_loadu_si256((const __m256i *)src);
+		if (swap) v = _mm256_shuffle_epi8(v, _mm256_loadu_si256((const __m256i *)swap32_mask));
+		return v;
+	}
+}
+
+static inline __m256d Half4ToDouble(__m128i v, GPMF_SampleType type)
+{
+	switch (type)
+	{
+	case GPMF_TYPE_FLOAT:
+		return _mm256_cvtps_pd(_mm_castsi128_ps(v));
+	case GPMF_TYPE_UNSIGNED_LONG: // bias into signed range; both steps are exact in double
+		return _mm256_add_pd(_mm256_cvtepi32_pd(_mm_xor_si128(v, _mm_set1_epi32((int)0x80000000))), _mm256_set1_pd(2147483648.0));
+	default:
+		return _mm256_cvtepi32_pd(v);
+	}
+}
+
+static inline void Convert8Double(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const double *scale, double *dst)
+{
+	__m256i v = Load8(src, type, swap);
+	__m256d lo = Half4ToDouble(_mm256_castsi256_si128(v), type);
+	__m256d hi = Half4ToDouble(_mm256_extracti128_si256(v, 1), type);
+	_mm256_storeu_pd(dst, _mm256_div_pd(lo, _mm256_loadu_pd(scale)));
+	_mm256_storeu_pd(dst + 4, _mm256_div_pd(hi, _mm256_loadu_pd(scale + 4)));
+}
+
+static inline void Convert8Float(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const float *scale, float *dst)
+{
+	__m256i v = Load8(src, type, swap);
+	__m256 f = type == GPMF_TYPE_FLOAT ? _mm256_castsi256_ps(v) : _mm256_cvtepi32_ps(v);
+	_mm256_storeu_ps(dst, _mm256_div_ps(f, _mm256_loadu_ps(scale)));
+}
+
+#define GPMF_SIMD_FLOAT_FROM_ULONG	0	// no exact single-rounding uint32 -> float on x86
+
+#elif GPMF_SIMD_SSE2
+
+static inline __m128i Swap16(__m128i v)
+{
+	return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+static inline __m128i Swap32(__m128i v)
+{
+	v = Swap16(v);
+	return _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+}
+
+// 8 integer values widened to two int32x4 halves (raw bits for floats)
+static inline void Load8(const uint8_t *src, GPMF_SampleType type, uint32_t swap, __m128i *lo, __m128i *hi)
+{
+	if (InputTypeSize(type) == 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)src);
+		if (swap) v = Swap16(v);
+		if (type == GPMF_TYPE_SIGNED_SHORT)
+		{
+			*lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+			*hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+		}
+		else
+		{
+			*lo = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+			*hi = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+		}
+	}
+	else
+	{
+		*lo = _mm_loadu_si128((const __m128i *)src);
+		*hi = _mm_loadu_si128((const __m128i *)(src + 16));
+		if (swap)
+		{
+			*lo = Swap32(*lo);
+			*hi = Swap32(*hi);
+		}
+	}
+}
+
+static inline void Half4Double(__m128i v, GPMF_SampleType type, const double *scale, double *dst)
+{
+	__m128d a, b;
+	switch (type)
+	{
+	case GPMF_TYPE_FLOAT:
+		a = _mm_cvtps_pd(_mm_castsi128_ps(v));
+		b = _mm_cvtps_pd(_mm_movehl_ps(_mm_castsi128_ps(v), _mm_castsi128_ps(v)));
+		break;
+	case GPMF_TYPE_UNSIGNED_LONG: // bias into signed range; both steps are exact in double
+		v = _mm_xor_si128(v, _mm_set1_epi32((int)0x80000000));
+		a = _mm_add_pd(_mm_cvtepi32_pd(v), _mm_set1_pd(2147483648.0));
+		b = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE)), _mm_set1_pd(2147483648.0));
+		break;
+	default:
+		a = _mm_cvtepi32_pd(v);
+		b = _mm_cvtepi32_pd(_mm_shuffle_epi32(v, 0xEE));
+		break;
+	}
+	_mm_storeu_pd(dst, _mm_div_pd(a, _mm_loadu_pd(scale)));
+	_mm_storeu_pd(dst + 2, _mm_div_pd(b, _mm_loadu_pd(scale + 2)));
+}
+
+static inline void Convert8Double(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const double *scale, double *dst)
+{
+	__m128i lo, hi;
+	Load8(src, type, swap, &lo, &hi);
+	Half4Double(lo, type, scale, dst);
+	Half4Double(hi, type, scale + 4, dst + 4);
+}
+
+static inline void Convert8Float(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const float *scale, float *dst)
+{
+	__m128i lo, hi;
+	__m128 a, b;
+	Load8(src, type, swap, &lo, &hi);
+	if (type == GPMF_TYPE_FLOAT)
+	{
+		a = _mm_castsi128_ps(lo);
+		b = _mm_castsi128_ps(hi);
+	}
+	else
+	{
+		a = _mm_cvtepi32_ps(lo);
+		b = _mm_cvtepi32_ps(hi);
+	}
+	_mm_storeu_ps(dst, _mm_div_ps(a, _mm_loadu_ps(scale)));
+	_mm_storeu_ps(dst + 4, _mm_div_ps(b, _mm_loadu_ps(scale + 4)));
+}
+
+#define GPMF_SIMD_FLOAT_FROM_ULONG	0	// no exact single-rounding uint32 -> float on x86
+
+#elif GPMF_SIMD_NEON
+
+// 8 values as two 32-bit quads (raw bits for floats)
+static inline void Load8(const uint8_t *src, GPMF_SampleType type, uint32_t swap, uint32x4_t *lo, uint32x4_t *hi)
+{
+	if (InputTypeSize(type) == 2)
+	{
+		uint8x16_t bytes = vld1q_u8(src);
+		if (swap) bytes = vrev16q_u8(bytes);
+		if (type == GPMF_TYPE_SIGNED_SHORT)
+		{
+			int16x8_t v = vreinterpretq_s16_u8(bytes);
+			*lo = vreinterpretq_u32_s32(vmovl_s16(vget_low_s16(v)));
+			*hi = vreinterpretq_u32_s32(vmovl_high_s16(v));
+		}
+		else
+		{
+			uint16x8_t v = vreinterpretq_u16_u8(bytes);
+			*lo = vmovl_u16(vget_low_u16(v));
+			*hi = vmovl_high_u16(v);
+		}
+	}
+	else
+	{
+		uint8x16_t a = vld1q_u8(src);
+		uint8x16_t b = vld1q_u8(src + 16);
+		if (swap)
+		{
+			a = vrev32q_u8(a);
+			b = vrev32q_u8(b);
+		}
+		*lo = vreinterpretq_u32_u8(a);
+		*hi = vreinterpretq_u32_u8(b);
+	}
+}
+
+static inline void Half4Double(uint32x4_t v, GPMF_SampleType type, const double *scale, double *dst)
+{
+	float64x2_t a, b;
+	switch (type)
+	{
+	case GPMF_TYPE_FLOAT:
+		a = vcvt_f64_f32(vget_low_f32(vreinterpretq_f32_u32(v)));
+		b = vcvt_high_f64_f32(vreinterpretq_f32_u32(v));
+		break;
+	case GPMF_TYPE_UNSIGNED_LONG:
+		a = vcvtq_f64_u64(vmovl_u32(vget_low_u32(v)));
+		b = vcvtq_f64_u64(vmovl_high_u32(v));
+		break;
+	default:
+		a = vcvtq_f64_s64(vmovl_s32(vget_low_s32(vreinterpretq_s32_u32(v))));
+		b = vcvtq_f64_s64(vmovl_high_s32(vreinterpretq_s32_u32(v)));
+		break;
+	}
+	vst1q_f64(dst, vdivq_f64(a, vld1q_f64(scale)));
+	vst1q_f64(dst + 2, vdivq_f64(b, vld1q_f64(scale + 2)));
+}
+
+static inline void Convert8Double(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const double *scale, double *dst)
+{
+	uint32x4_t lo, hi;
+	Load8(src, type, swap, &lo, &hi);
+	Half4Double(lo, type, scale, dst);
+	Half4Double(hi, type, scale + 4, dst + 4);
+}
+
+static inline float32x4_t Half4Float(uint32x4_t v, GPMF_SampleType type)
+{
+	switch (type)
+	{
+	case GPMF_TYPE_FLOAT:			return vreinterpretq_f32_u32(v);
+	case GPMF_TYPE_UNSIGNED_LONG:	return vcvtq_f32_u32(v);
+	default:						return vcvtq_f32_s32(vreinterpretq_s32_u32(v));
+	}
+}
+
+static inline void Convert8Float(const uint8_t *src, GPMF_SampleType type, uint32_t swap, const float *scale, float *dst)
+{
+	uint32x4_t lo, hi;
+	Load8(src, type, swap, &lo, &hi);
+	vst1q_f32(dst, vdivq_f32(Half4Float(lo, type), vld1q_f32(scale)));
+	vst1q_f32(dst + 4, vdivq_f32(Half4Float(hi, type), vld1q_f32(scale + 4)));
+}
+
+#define GPMF_SIMD_FLOAT_FROM_ULONG	1
+
+#endif
+
+
+void GPMF_SIMD_ScaleToDouble(const uint8_t *src, GPMF_SampleType inputType, uint32_t swap,
+	const double *scale, uint32_t elements, double *dst, uint32_t count)
+{
+	uint32_t typesize = InputTypeSize(inputType);
+	uint32_t n = 0;
+
+	if (typesize == 0 || elements == 0 || elements > GPMF_SIMD_MAX_ELEMENTS)
+		return;
+
+#if GPMF_SIMD_AVX2 || GPMF_SIMD_SSE2 || GPMF_SIMD_NEON
+	{
+		double tile[GPMF_SIMD_TILE];
+		uint32_t tilesize = elements * GPMF_SIMD_RUN;
+		uint32_t i;
+
+		for (i = 0; i < tilesize; i++)
+			tile[i] = scale[i % elements];
+
+		for (; n + tilesize <= count; n += tilesize)
+		{
+			for (i = 0; i < tilesize; i += GPMF_SIMD_RUN)
+				Convert8Double(src + (size_t)(n + i) * typesize, inputType, swap, &tile[i], &dst[n + i]);
+		}
+	}
+#endif
+
+	// n is a multiple of elements here, so the scale index stays in step
+	for (; n < count; n++)
+		dst[n] = ReadValue(src + (size_t)n * typesize, inputType, swap) / scale[n % elements];
+}
+
+
+void GPMF_SIMD_ScaleToFloat(const uint8_t *src, GPMF_SampleType inputType, uint32_t swap,
+	const double *scale, uint32_t elements, float *dst, uint32_t count)
+{
+	uint32_t typesize = InputTypeSize(inputType);
+	uint32_t n = 0;
+
+	if (typesize == 0 || elements == 0 || elements > GPMF_SIMD_MAX_ELEMENTS)
+		return;
+
+#if GPMF_SIMD_AVX2 || GPMF_SIMD_SSE2 || GPMF_SIMD_NEON
+	if (inputType != GPMF_TYPE_UNSIGNED_LONG || GPMF_SIMD_FLOAT_FROM_ULONG)
+	{
+		float tile[GPMF_SIMD_TILE];
+		uint32_t tilesize = elements * GPMF_SIMD_RUN;
+		uint32_t i;
+
+		for (i = 0; i < tilesize; i++)
+			tile[i] = (float)scale[i % elements];
+
+		for (; n + tilesize <= count; n += tilesize)
+		{
+			for (i = 0; i < tilesize; i += GPMF_SIMD_RUN)
+				Convert8Float(src + (size_t)(n + i) * typesize, inputType, swap, &tile[i], &dst[n + i]);
+		}
+	}
+#endif
+
+	for (; n < count; n++)
+		dst[n] = (float)ReadValue(src + (size_t)n * typesize, inputType, swap) / (float)scale[n % elements];
+}
@@ -0,0 +1,42 @@
+/*! @file GPMF_simd.h
+ *
+ *  @brief Vectorized byte-swap, convert and scale kernels used by GPMF_ScaledData
+ *
+ *  Homogeneous streams (ACCL/GYRO as 's', GPS5 as 'l', ...) are converted in a
+ *  single pass: big-endian load, byte-swap, widen to float/double and divide by
+ *  SCAL. The ISA is picked at compile time (AVX2, SSE2 or AArch64 NEON), with a
+ *  scalar fallback that is also used for the tail of every run.
+ *
+ *  Results are bit-identical to the generic MACRO_BSWAP_CAST_SCALE path: the
+ *  scale is applied as a true division, not as a multiply by the reciprocal.
+ */
+
+#ifndef _GPMF_SIMD_H
+#define _GPMF_SIMD_H
+
+#include <stdint.h>
+#include "GPMF_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPMF_SIMD_MAX_ELEMENTS	64	// scale vector length handled by the kernels
+
+// Returns 1 if the kernels handle this input/output type pair and element count.
+uint32_t GPMF_SIMD_Supported(GPMF_SampleType inputType, GPMF_SampleType outputType, uint32_t elements);
+
+// Converts 'count' values of 'inputType' at 'src' (big-endian when 'swap' is set, native otherwise)
+// to doubles, dividing value n by scale[n % elements]. 'src' and 'dst' need no particular alignment.
+void GPMF_SIMD_ScaleToDouble(const uint8_t *src, GPMF_SampleType inputType, uint32_t swap,
+	const double *scale, uint32_t elements, double *dst, uint32_t count);
+
+// Same as GPMF_SIMD_ScaleToDouble, producing floats ((float)value / (float)scale).
+void GPMF_SIMD_ScaleToFloat(const uint8_t *src, GPMF_SampleType inputType, uint32_t swap,
+	const double *scale, uint32_t elements, float *dst, uint32_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,389 @@
+//
+//  gpmf_bench.c
+//  Benchmark do parser GPMF e do bridge sobre um corpus de arquivos MP4
+//
+//  Cada estágio é medido separadamente, em todas as iterações, e o relatório
+//  usa a mediana (menos sensível a ruído do que a média):
+//    open        OpenMP4Source (leitura do moov e índice de payloads)
+//    payloads    GetPayloadSize/GetPayloadResource/GetPayload + leitura dos bytes
+//    scaled      GPMF_ScaledData em double de todos os STRM (descompressão incluída)
+//    decompress  GPMF_Decompress isolado, só nos STRM comprimidos ('#')
+//    bridge      parse_gpmf_columns_with_options de ponta a ponta
+//
+//  Com -p, uma extração extra por arquivo (fora da medida) imprime o perfil
+//  do bridge (C_GPMFProfile) somado sobre o corpus.
+//
+
+#include "GPMFBridge.h"
+#include "GPMF_parser.h"
+#include "GPMF_mp4reader.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <strings.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define MAX_ITERATIONS 100
+#define MAX_FILES 4096
+
+enum { STAGE_OPEN, STAGE_PAYLOADS, STAGE_SCALED, STAGE_DECOMPRESS, STAGE_BRIDGE, STAGE_COUNT };
+
+static const char* stage_names[STAGE_COUNT] = { "open", "payloads", "scaled", "decompress", "bridge" };
+
+// Volume processado por um estágio numa iteração (igual em todas as iterações)
+typedef struct {
+    uint64_t bytes;
+    uint64_t payloads;
+    uint64_t samples;
+} StageVolume;
+
+typedef struct {
+    char* files[MAX_FILES];
+    int count;
+} Corpus;
+
+// MARK: - HELPERS
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// FNV-1a sobre palavras de 32 bits: ao contrário de um XOR, a ordem conta e
+// valores repetidos não se anulam
+static uint32_t checksum_words(uint32_t hash, const uint32_t* words, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        hash ^= words[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static double median(double* values, int count) {
+    qsort(values, (size_t)count, sizeof(double), compare_doubles);
+    return count % 2 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+}
+
+static int has_mp4_extension(const char* name) {
+    const char* dot = strrchr(name, '.');
+    return dot && (strcasecmp(dot, ".mp4") == 0 || strcasecmp(dot, ".360") == 0);
+}
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+// Arquivos soltos entram como estão; diretórios contribuem com os .MP4/.360 (não recursivo)
+static void add_to_corpus(Corpus* corpus, const char* path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "gpmf-bench: %s não encontrado\n", path);
+        return;
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+        if (corpus->count < MAX_FILES) corpus->files[corpus->count++] = strdup(path);
+        return;
+    }
+
+    DIR* dir = opendir(path);
+    if (!dir) return;
+
+    int first = corpus->count;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL && corpus->count < MAX_FILES) {
+        if (entry->d_name[0] == '.' || !has_mp4_extension(entry->d_name)) continue;
+
+        size_t size = strlen(path) + strlen(entry->d_name) + 2;
+        char* full = malloc(size);
+        if (!full) break;
+        snprintf(full, size, "%s/%s", path, entry->d_name);
+        corpus->files[corpus->count++] = full;
+    }
+    closedir(dir);
+
+    // Ordem estável entre execuções
+    qsort(corpus->files + first, (size_t)(corpus->count - first), sizeof(char*), compare_strings);
+}
+
+// MARK: - ESTÁGIOS
+
+// Mede open, leitura de payloads, escala e descompressão de um arquivo
+static void bench_parser(const char* file_path, double* seconds, StageVolume* volume, uint32_t* checksum) {
+    double t = now_seconds();
+    size_t mp4Handle = OpenMP4Source((char*)file_path, MOV_GPMF_TRAK_TYPE, MOV_GPMF_TRAK_SUBTYPE, MP4_FLAG_MEMORY_MAP);
+    seconds[STAGE_OPEN] += now_seconds() - t;
+    if (!mp4Handle) {
+        fprintf(stderr, "gpmf-bench: %s sem trilha GPMF\n", file_path);
+        return;
+    }
+    volume[STAGE_OPEN].payloads += 1; // Aqui conta arquivos abertos
+
+    uint32_t payload_count = GetNumberPayloads(mp4Handle);
+    size_t payloadres = 0;
+
+    double* scaled = NULL;
+    uint32_t scaled_capacity = 0;
+    uint32_t* decompressed = NULL;
+    uint32_t decompressed_capacity = 0;
+    GPMF_scratch scratch; // Mesmo reaproveitamento do bridge: um scratch de descompressão por arquivo
+    memset(&scratch, 0, sizeof(scratch));
+
+    for (uint32_t index = 0; index < payload_count; index++) {
+        // Leitura: com o mapa a cópia não existe, então os bytes são somados para
+        // que as páginas sejam de fato lidas do disco dentro do estágio
+        t = now_seconds();
+        uint32_t payloadSize = GetPayloadSize(mp4Handle, index);
+        payloadres = GetPayloadResource(mp4Handle, payloadres, payloadSize);
+        uint32_t* payload = GetPayload(mp4Handle, payloadres, index);
+        if (payload) {
+            uint32_t sum = 0;
+            for (uint32_t w = 0; w < payloadSize / 4; w++) sum ^= payload[w];
+            seconds[STAGE_PAYLOADS] += now_seconds() - t;
+            *checksum = checksum_words(*checksum, &sum, 1);
+        } else {
+            seconds[STAGE_PAYLOADS] += now_seconds() - t;
+        }
+        if (!payload) continue;
+
+        volume[STAGE_PAYLOADS].bytes += payloadSize;
+        volume[STAGE_PAYLOADS].payloads += 1;
+
+        GPMF_stream gs;
+        if (GPMF_Init(&gs, payload, payloadSize) != GPMF_OK) continue;
+        GPMF_SetScratch(&gs, &scratch);
+
+        volume[STAGE_SCALED].bytes += payloadSize;
+        volume[STAGE_SCALED].payloads += 1;
+
+        int has_compressed = 0;
+        while (GPMF_FindNext(&gs, GPMF_KEY_STREAM, GPMF_RECURSE_LEVELS) == GPMF_OK) {
+            GPMF_stream data_stream;
+            GPMF_CopyState(&gs, &data_stream);
+            if (GPMF_SeekToSamples(&data_stream) != GPMF_OK) continue;
+
+            uint32_t samples = GPMF_PayloadSampleCount(&data_stream);
+            uint32_t elements = GPMF_ElementsInStruct(&data_stream);
+            if (samples == 0 || elements == 0) continue;
+
+            // Descompressão isolada (numa cópia, para a escala abaixo partir do zero).
+            // GPMF_Type devolve o tipo interno de um KLV '#', então o tipo vem do cabeçalho.
+            const uint8_t* header = (const uint8_t*)GPMF_RawData(&data_stream) - 4;
+            if (header[0] == GPMF_TYPE_COMPRESSED) {
+                uint32_t needed = 0;
+                if (GPMF_DecompressedSize(&data_stream, &needed) == GPMF_OK && needed > 0) {
+                    if (needed > decompressed_capacity) {
+                        uint32_t* grown = realloc(decompressed, needed);
+                        if (grown) {
+                            decompressed = grown;
+                            decompressed_capacity = needed;
+                        }
+                    }
+                    if (needed <= decompressed_capacity) {
+                        GPMF_stream compressed_stream;
+                        GPMF_CopyState(&data_stream, &compressed_stream);
+
+                        t = now_seconds();
+                        GPMF_ERR err = GPMF_Decompress(&compressed_stream, decompressed, needed);
+                        seconds[STAGE_DECOMPRESS] += now_seconds() - t;
+
+                        if (err == GPMF_OK) {
+                            volume[STAGE_DECOMPRESS].bytes += GPMF_RawDataSize(&data_stream);
+                            volume[STAGE_DECOMPRESS].samples += samples;
+                            has_compressed = 1;
+                        }
+                    }
+                }
+            }
+
+            uint32_t buffersize = samples * elements * (uint32_t)sizeof(double);
+            if (buffersize > scaled_capacity) {
+                double* grown = realloc(scaled, buffersize);
+                if (!grown) continue;
+                scaled = grown;
+                scaled_capacity = buffersize;
+            }
+
+            t = now_seconds();
+            GPMF_ERR err = GPMF_ScaledData(&data_stream, scaled, buffersize, 0, samples, GPMF_TYPE_DOUBLE);
+            seconds[STAGE_SCALED] += now_seconds() - t;
+
+            if (err == GPMF_OK) {
+                volume[STAGE_SCALED].samples += samples;
+                // Valores escalados entram no checksum fora da medida
+                *checksum = checksum_words(*checksum, (const uint32_t*)scaled, (size_t)samples * elements * 2);
+            }
+        }
+        if (has_compressed) volume[STAGE_DECOMPRESS].payloads += 1;
+    }
+
+    free(scaled);
+    free(decompressed);
+    GPMF_FreeScratch(&scratch);
+    if (payloadres) FreePayloadResource(mp4Handle, payloadres);
+    CloseSource(mp4Handle);
+}
+
+// Extração completa pelo bridge (mesmo caminho do app, sem cache em disco)
+static void bench_bridge(const char* file_path, const C_GPMFParseOptions* options, double* seconds, StageVolume* volume) {
+    double t = now_seconds();
+    C_GPMFColumnSet* set = parse_gpmf_columns_with_options(file_path, options);
+    seconds[STAGE_BRIDGE] += now_seconds() - t;
+    if (!set) return;
+
+    for (int32_t i = 0; i < set->stream_count; i++) {
+        volume[STAGE_BRIDGE].samples += (uint64_t)set->streams[i].sample_count;
+    }
+    free_column_set(set);
+}
+
+// MARK: - RELATÓRIO
+
+static void print_rate(double amount, double seconds, double unit) {
+    if (amount > 0.0 && seconds > 0.0) printf(" %14.1f", amount / unit / seconds);
+    else printf(" %14s", "-");
+}
+
+static void print_report(double times[STAGE_COUNT][MAX_ITERATIONS], const StageVolume* volume, int iterations) {
+    printf("\n%-12s %12s %14s %14s %14s\n", "estágio", "mediana(ms)", "MB/s", "payloads/s", "samples/s");
+
+    for (int s = 0; s < STAGE_COUNT; s++) {
+        double seconds = median(times[s], iterations);
+        const StageVolume* v = &volume[s];
+
+        // Open e bridge processam os mesmos bytes/payloads lidos pela passada do parser
+        double bytes = (double)v->bytes, payloads = (double)v->payloads;
+        if (s == STAGE_BRIDGE) {
+            bytes = (double)volume[STAGE_PAYLOADS].bytes;
+            payloads = (double)volume[STAGE_PAYLOADS].payloads;
+        }
+
+        printf("%-12s %12.3f", stage_names[s], seconds * 1000.0);
+        print_rate(s == STAGE_OPEN ? 0.0 : bytes, seconds, 1024.0 * 1024.0);
+        print_rate(s == STAGE_OPEN ? 0.0 : payloads, seconds, 1.0);
+        print_rate((double)v->samples, seconds, 1.0);
+        printf("\n");
+    }
+
+    printf("\nopen: %llu arquivo(s) por iteração; decompress: MB/s sobre os bytes comprimidos\n",
+           (unsigned long long)volume[STAGE_OPEN].payloads);
+}
+
+// Perfil do bridge: uma extração por arquivo, fora das iterações medidas
+static void print_profile(const Corpus* corpus, const C_GPMFParseOptions* options) {
+    C_GPMFProfile total, profile;
+    memset(&total, 0, sizeof(total));
+    C_GPMFParseOptions profiled = *options;
+    profiled.profile = &profile;
+
+    for (int f = 0; f < corpus->count; f++) {
+        C_GPMFColumnSet* set = parse_gpmf_columns_with_options(corpus->files[f], &profiled);
+        if (set) free_column_set(set);
+
+        const uint64_t* src = (const uint64_t*)&profile;
+        uint64_t* dst = (uint64_t*)&total;
+        for (size_t i = 0; i < offsetof(C_GPMFProfile, thread_count) / sizeof(uint64_t); i++) dst[i] += src[i];
+        total.thread_count = profile.thread_count;
+    }
+
+    printf("\nperfil do bridge (%d thread(s); estágios dos workers somam todas as threads)\n", total.thread_count);
+    printf("  átomos %llu, payloads %llu, bytes lidos %llu, bytes mapeados %llu\n",
+           (unsigned long long)total.atoms_visited, (unsigned long long)total.payloads_visited,
+           (unsigned long long)total.bytes_read, (unsigned long long)total.bytes_mapped);
+    printf("  KLVs %llu, KLVs comprimidos %llu (%llu bytes), samples escalados %llu, alocações %llu\n",
+           (unsigned long long)total.klvs_stepped, (unsigned long long)total.compressed_klvs,
+           (unsigned long long)total.compressed_bytes, (unsigned long long)total.samples_scaled,
+           (unsigned long long)total.allocations);
+
+    const char* names[] = { "open", "read", "index", "decompress", "scale", "accumulate", "finalize", "total" };
+    const uint64_t ns[] = { total.open_ns, total.read_ns, total.index_ns, total.decompress_ns,
+                            total.scale_ns, total.accumulate_ns, total.finalize_ns, total.total_ns };
+    for (size_t i = 0; i < sizeof(ns) / sizeof(ns[0]); i++) {
+        printf("  %-12s %12.3f ms\n", names[i], (double)ns[i] / 1e6);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "uso: gpmf-bench [-n iterações] [-w aquecimento] [-t threads] [-p] arquivo|diretório...\n"
+            "  -n  iterações medidas (padrão 5, máximo %d)\n"
+            "  -w  iterações de aquecimento, fora da medida (padrão 1)\n"
+            "  -t  threads do bridge (padrão 0 = núcleos disponíveis)\n"
+            "  -p  imprime o perfil por estágio do bridge\n",
+            MAX_ITERATIONS);
+}
+
+int main(int argc, char** argv) {
+    int iterations = 5, warmup = 1, profile = 0;
+    C_GPMFParseOptions options;
+    memset(&options, 0, sizeof(options));
+
+    static Corpus corpus;
+    for (int i = 1; i < argc; i++) {
+        if ((strcmp(argv[i], "-n") == 0 || strcmp(argv[i], "-w") == 0 || strcmp(argv[i], "-t") == 0) && i + 1 < argc) {
+            int value = atoi(argv[i + 1]);
+            if (argv[i][1] == 'n') iterations = value;
+            else if (argv[i][1] == 'w') warmup = value;
+            else options.thread_count = value;
+            i++;
+        } else if (strcmp(argv[i], "-p") == 0) {
+            profile = 1;
+        } else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        } else {
+            add_to_corpus(&corpus, argv[i]);
+        }
+    }
+
+    if (corpus.count == 0 || iterations < 1 || iterations > MAX_ITERATIONS || warmup < 0) {
+        usage();
+        return 2;
+    }
+
+    // Medidas sem cache em disco: todo arquivo é lido e decodificado de verdade
+    gpmf_set_cache_directory(NULL);
+
+    printf("gpmf-bench: %d arquivo(s), %d iteração(ões) + %d de aquecimento\n", corpus.count, iterations, warmup);
+
+    static double times[STAGE_COUNT][MAX_ITERATIONS];
+    StageVolume volume[STAGE_COUNT];
+    uint32_t checksum = 0, previous_checksum = 0;
+
+    for (int iter = -warmup; iter < iterations; iter++) {
+        double seconds[STAGE_COUNT] = { 0 };
+        memset(volume, 0, sizeof(volume));
+        checksum = 2166136261u; // Cada iteração refaz o mesmo trabalho, então o checksum é por iteração
+
+        for (int f = 0; f < corpus.count; f++) {
+            bench_parser(corpus.files[f], seconds, volume, &checksum);
+            bench_bridge(corpus.files[f], &options, seconds, volume);
+        }
+
+        if (iter >= 0) {
+            for (int s = 0; s < STAGE_COUNT; s++) times[s][iter] = seconds[s];
+        }
+        if (iter > -warmup && checksum != previous_checksum) {
+            fprintf(stderr, "gpmf-bench: checksum da iteração %d difere da anterior (%08x != %08x)\n",
+                    iter, checksum, previous_checksum);
+        }
+        previous_checksum = checksum;
+    }
+
+    print_report(times, volume, iterations);
+    if (profile) print_profile(&corpus, &options);
+    printf("checksum: %08x\n", checksum);
+
+    for (int f = 0; f < corpus.count; f++) free(corpus.files[f]);
+    return 0;
+}
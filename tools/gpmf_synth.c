@@ -0,0 +1,821 @@
+//
+//  gpmf_synth.c
+//  Gerador de arquivos MP4 sintéticos com trilha GPMF (testes de escala e estresse)
+//
+//  Cada payload é um DEVC com DVID/DVNM e um STRM por stream pedido, no mesmo
+//  formato das câmeras: STMP (µs do primeiro sample), TSMP (total acumulado),
+//  SIUN, SCAL, TMPC nos streams da IMU e os samples (opcionalmente comprimidos
+//  em '#'). A IMU pode vir com ORIN/ORIO ou MTRX, e o GPS9 usa TYPE, para
+//  exercitar os caminhos de calibração do parser. Os payloads vão direto para o mdat à medida que são gerados; o moov
+//  (trak 'meta'/'gpmd' com stts/stsc/stsz/stco ou co64) é escrito no final.
+//  Os sinais são determinísticos para a mesma semente, então o mesmo comando
+//  gera o mesmo arquivo.
+//
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#define MAX_SYNTH_STREAMS 8
+#define META_TIMESCALE 1000
+
+// MARK: - BUFFER
+
+typedef struct {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+static void buffer_reserve(ByteBuffer* b, size_t extra) {
+    if (b->size + extra <= b->capacity) return;
+    size_t capacity = b->capacity ? b->capacity : 4096;
+    while (capacity < b->size + extra) capacity *= 2;
+    uint8_t* grown = realloc(b->data, capacity);
+    if (!grown) {
+        fprintf(stderr, "gpmf-synth: sem memória\n");
+        exit(1);
+    }
+    b->data = grown;
+    b->capacity = capacity;
+}
+
+static void put_bytes(ByteBuffer* b, const void* bytes, size_t count) {
+    buffer_reserve(b, count);
+    memcpy(b->data + b->size, bytes, count);
+    b->size += count;
+}
+
+static void put_u8(ByteBuffer* b, uint8_t v) { put_bytes(b, &v, 1); }
+
+static void put_be16(ByteBuffer* b, uint16_t v) {
+    uint8_t bytes[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+    put_bytes(b, bytes, 2);
+}
+
+static void put_be32(ByteBuffer* b, uint32_t v) {
+    uint8_t bytes[4] = { (uint8_t)(v >> 24), (uint8_t)(v >> 16), (uint8_t)(v >> 8), (uint8_t)v };
+    put_bytes(b, bytes, 4);
+}
+
+static void put_be64(ByteBuffer* b, uint64_t v) {
+    put_be32(b, (uint32_t)(v >> 32));
+    put_be32(b, (uint32_t)v);
+}
+
+static void patch_be32(ByteBuffer* b, size_t offset, uint32_t v) {
+    b->data[offset] = (uint8_t)(v >> 24);
+    b->data[offset + 1] = (uint8_t)(v >> 16);
+    b->data[offset + 2] = (uint8_t)(v >> 8);
+    b->data[offset + 3] = (uint8_t)v;
+}
+
+static void pad4(ByteBuffer* b) {
+    while (b->size & 3) put_u8(b, 0);
+}
+
+// MARK: - KLV
+
+// Cabeçalho KLV: FourCC, tipo, tamanho da estrutura, repetições (big-endian)
+static void put_klv_header(ByteBuffer* b, const char* key, char type, uint8_t struct_size, uint16_t repeat) {
+    put_bytes(b, key, 4);
+    put_u8(b, (uint8_t)type);
+    put_u8(b, struct_size);
+    put_be16(b, repeat);
+}
+
+static void put_klv_string(ByteBuffer* b, const char* key, const char* text) {
+    size_t length = strlen(text);
+    put_klv_header(b, key, 'c', 1, (uint16_t)length);
+    put_bytes(b, text, length);
+    pad4(b);
+}
+
+static void put_klv_u32(ByteBuffer* b, const char* key, uint32_t value) {
+    put_klv_header(b, key, 'L', 4, 1);
+    put_be32(b, value);
+}
+
+// Abre um KLV aninhado (DEVC/STRM); o tamanho é preenchido em end_nest
+static size_t begin_nest(ByteBuffer* b, const char* key) {
+    size_t header = b->size;
+    put_klv_header(b, key, 0, 0, 0);
+    return header;
+}
+
+static void end_nest(ByteBuffer* b, size_t header) {
+    size_t bytes = b->size - header - 8; // Sempre múltiplo de 4
+    if (bytes <= 0xFFFF) {
+        b->data[header + 5] = 1;
+        b->data[header + 6] = (uint8_t)(bytes >> 8);
+        b->data[header + 7] = (uint8_t)bytes;
+    } else {
+        b->data[header + 5] = 4;
+        b->data[header + 6] = (uint8_t)((bytes / 4) >> 8);
+        b->data[header + 7] = (uint8_t)(bytes / 4);
+    }
+}
+
+// MARK: - COMPRESSÃO ('#')
+
+// Tabelas do formato (as mesmas de GPMF_bitstream.h, lado do codificador)
+static const struct { uint8_t size; uint16_t bits; } value_codes[39] = {
+    { 1, 0x0 },    { 2, 0x2 },    { 4, 0xC },    { 5, 0x1B },   { 5, 0x1D },   { 6, 0x34 },
+    { 6, 0x35 },   { 6, 0x3E },   { 7, 0x70 },   { 7, 0x73 },   { 7, 0x78 },   { 7, 0x79 },
+    { 7, 0x7B },   { 8, 0xE4 },   { 8, 0xE5 },   { 8, 0xF4 },   { 9, 0x1C5 },  { 9, 0x1C6 },
+    { 9, 0x1EA },  { 10, 0x388 }, { 10, 0x38E }, { 10, 0x3D6 }, { 10, 0x3FC }, { 11, 0x712 },
+    { 11, 0x71F }, { 11, 0x7AE }, { 12, 0xE27 }, { 12, 0xE3D }, { 12, 0xF5F }, { 13, 0x1C4D },
+    { 13, 0x1C79 }, { 13, 0x1EBD }, { 14, 0x3898 }, { 14, 0x38F0 }, { 14, 0x3D78 }, { 14, 0x3D79 },
+    { 15, 0x7132 }, { 15, 0x7133 }, { 15, 0x71E3 },
+};
+static const struct { uint8_t size; uint16_t bits; uint16_t count; } zero_run_codes[4] = {
+    { 10, 0x3FD, 128 }, { 9, 0x1FF, 64 }, { 8, 0xFE, 32 }, { 7, 0x7E, 16 },
+};
+#define ESCAPE_CODE 0xE3C4
+#define END_CODE    0xE3C5
+
+// Bits MSB primeiro em palavras de 16 bits big-endian
+typedef struct {
+    ByteBuffer* out;
+    uint32_t acc;
+    int count;
+} BitWriter;
+
+static void put_bits(BitWriter* w, uint32_t bits, int size) {
+    for (int i = size - 1; i >= 0; i--) {
+        w->acc = (w->acc << 1) | ((bits >> i) & 1);
+        if (++w->count == 16) {
+            put_be16(w->out, (uint16_t)w->acc);
+            w->acc = 0;
+            w->count = 0;
+        }
+    }
+}
+
+static void flush_bits(BitWriter* w) {
+    if (w->count > 0) put_bits(w, 0, 16 - w->count);
+}
+
+static void put_zero_run(BitWriter* w, uint32_t zeros) {
+    for (int z = 0; z < 4; z++) {
+        while (zeros >= zero_run_codes[z].count) {
+            put_bits(w, zero_run_codes[z].bits, zero_run_codes[z].size);
+            zeros -= zero_run_codes[z].count;
+        }
+    }
+    while (zeros--) put_bits(w, 0, 1);
+}
+
+// O decodificador de referência lê janelas de 16 bits: um código de run só no início,
+// zeros avulsos e, se couber, um valor. Com valor, o delta entra primeiro e os zeros
+// da janela repetem o valor novo; sem valor, repetem o anterior.
+// Retorna os bits ainda abertos na última janela de put_zero_run(zeros) (0 = fechada).
+static int zero_run_open_bits(uint32_t zeros) {
+    int used = 0;
+    for (int z = 0; z < 4; z++) {
+        while (zeros >= zero_run_codes[z].count) {
+            used = zero_run_codes[z].size;
+            zeros -= zero_run_codes[z].count;
+        }
+    }
+    while (zeros--) {
+        if (used == 16) used = 0;
+        used++;
+    }
+    return used == 16 ? 0 : used;
+}
+
+// Quantos dos zeros que seguem um valor cabem antes dele na mesma janela (room bits),
+// e com qual código de run (-1 = só zeros avulsos).
+static uint32_t zeros_in_value_window(uint32_t zeros, int room, int* run_code) {
+    uint32_t best = zeros < (uint32_t)room ? zeros : (uint32_t)room;
+    *run_code = -1;
+    for (int z = 0; z < 4; z++) {
+        int spare = room - zero_run_codes[z].size;
+        if (spare < 0 || zeros < zero_run_codes[z].count) continue;
+        uint32_t fit = zero_run_codes[z].count + (uint32_t)spare;
+        if (fit > zeros) fit = zeros;
+        if (fit > best) {
+            best = fit;
+            *run_code = z;
+        }
+    }
+    return best;
+}
+
+// Um canal 16 bits: quant (1 = sem perda), deltas codificados e END.
+// Cada delta leva consigo os zeros que o seguem, na ordem do decodificador de referência;
+// o que não cabe na janela dele vai em runs próprias. Se o valor se juntaria a uma janela
+// de zeros ainda aberta, sai como ESC. Zeros no final do canal ficam implícitos no END.
+static void compress_channel(ByteBuffer* b, const int16_t* values, uint32_t samples, uint32_t stride) {
+    put_be16(b, 1);
+
+    BitWriter w = { b, 0, 0 };
+    uint32_t s = 1;
+    while (s < samples && values[s * stride] == values[(s - 1) * stride]) s++;
+    put_zero_run(&w, s - 1);
+    int open = zero_run_open_bits(s - 1);
+
+    while (s < samples) {
+        int16_t delta = (int16_t)(uint16_t)((uint16_t)values[s * stride] - (uint16_t)values[(s - 1) * stride]);
+        uint32_t next = s + 1;
+        while (next < samples && values[next * stride] == values[(next - 1) * stride]) next++;
+        uint32_t trailing = next - s - 1;
+
+        int magnitude = delta < 0 ? -delta : delta;
+        uint32_t absorbed = 0;
+        int coded = 0;
+        if (magnitude < 39) {
+            int value_bits = value_codes[magnitude].size + 1;
+            int run_code;
+            absorbed = zeros_in_value_window(trailing, 16 - value_bits, &run_code);
+            // Zeros avulsos continuariam a janela aberta; um código de run sempre abre outra
+            if (open > 0 && run_code < 0) absorbed = 0;
+
+            if (open == 0 || absorbed > 0 || open + value_bits > 16) {
+                uint32_t singles = absorbed;
+                if (absorbed > 0 && run_code >= 0) {
+                    put_bits(&w, zero_run_codes[run_code].bits, zero_run_codes[run_code].size);
+                    singles -= zero_run_codes[run_code].count;
+                }
+                while (singles--) put_bits(&w, 0, 1);
+                put_bits(&w, value_codes[magnitude].bits, value_codes[magnitude].size);
+                put_bits(&w, delta < 0 ? 1 : 0, 1); // Sinal
+                coded = 1;
+            }
+        }
+        if (!coded) {
+            put_bits(&w, ESCAPE_CODE, 16);
+            put_bits(&w, (uint16_t)delta, 16);
+        }
+
+        open = 0;
+        if (next < samples) {
+            put_zero_run(&w, trailing - absorbed);
+            open = zero_run_open_bits(trailing - absorbed);
+        }
+        s = next;
+    }
+    put_bits(&w, END_CODE, 16);
+    flush_bits(&w);
+}
+
+// KLV '#' de samples 's': cabeçalho original, primeiro sample cru e um canal por elemento.
+// Retorna 0 se não couber (o chamador grava sem compressão).
+static int put_compressed_shorts(ByteBuffer* b, const char* key, const int16_t* values, uint32_t samples, uint32_t elements) {
+    ByteBuffer packed = { 0 };
+    put_u8(&packed, 's');
+    put_u8(&packed, (uint8_t)(elements * 2));
+    put_be16(&packed, (uint16_t)samples);
+    for (uint32_t j = 0; j < elements; j++) put_be16(&packed, (uint16_t)values[j]);
+    for (uint32_t j = 0; j < elements; j++) compress_channel(&packed, values + j, samples, elements);
+
+    int ok = packed.size <= 0xFFFF;
+    if (ok) {
+        put_klv_header(b, key, '#', 1, (uint16_t)packed.size);
+        put_bytes(b, packed.data, packed.size);
+        pad4(b);
+    }
+    free(packed.data);
+    return ok;
+}
+
+// MARK: - STREAMS
+
+typedef enum { SYNTH_ACCL, SYNTH_GYRO, SYNTH_CORI, SYNTH_GPS5, SYNTH_GPS9, SYNTH_SHUT, SYNTH_KIND_COUNT } SynthKind;
+
+typedef struct {
+    const char* key;
+    const char* name;
+    const char* units;
+    char type;             // 's', 'l', 'f' ou '?' (estrutura descrita em TYPE)
+    uint32_t elements;
+    double default_rate;
+    int32_t scale[9];      // SCAL por elemento (ignorado em 'f')
+    const char* complex;   // TYPE dos streams '?'
+} SynthKindInfo;
+
+static const SynthKindInfo kinds[SYNTH_KIND_COUNT] = {
+    { "ACCL", "Accelerometer", "m/s\xb2", 's', 3, 200.0, { 418, 418, 418 } },
+    { "GYRO", "Gyroscope", "rad/s", 's', 3, 200.0, { 939, 939, 939 } },
+    { "CORI", "CameraOrientation", "", 's', 4, 30.0, { 32767, 32767, 32767, 32767 } },
+    { "GPS5", "GPS (Lat., Long., Alt., 2D speed, 3D speed)", "degdegm\0\0m/sm/s", 'l', 5, 18.0, { 10000000, 10000000, 1000, 1000, 100 } },
+    { "GPS9", "GPS (Lat., Long., Alt., 2D, 3D, days, secs, DOP, fix)", "degdegm\0\0m/sm/s\0\0\0s\0\0\0\0\0\0\0\0", '?', 9, 10.0,
+      { 10000000, 10000000, 1000, 1000, 100, 1, 1000, 100, 1 }, "lllllllSS" },
+    { "SHUT", "Exposure time (shutter speed)", "s", 'f', 1, 29.97, { 1 } },
+};
+
+typedef struct {
+    SynthKind kind;
+    double rate;           // Hz
+    uint64_t total;        // TSMP acumulado
+} SynthStream;
+
+typedef struct {
+    double duration;       // Segundos de gravação
+    double payload_seconds;
+    int compress;
+    int orientation;       // ORIN/ORIO na IMU
+    int matrix;            // MTRX na IMU (tem precedência sobre ORIN/ORIO, como no parser)
+    uint32_t seed;
+    SynthStream streams[MAX_SYNTH_STREAMS];
+    int stream_count;
+} SynthConfig;
+
+// Ruído determinístico em [-1, 1) (xorshift)
+static double noise(uint32_t* state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return (double)x / 2147483648.0 - 1.0;
+}
+
+// Valor físico do elemento j no instante t (antes da escala)
+static double signal_value(SynthKind kind, uint32_t j, double t, uint32_t* state) {
+    switch (kind) {
+    case SYNTH_ACCL: return (j == 1 ? 9.81 : 0.0) + 2.0 * sin(t * (1.3 + j)) + 0.05 * noise(state);
+    case SYNTH_GYRO: return 0.8 * sin(t * (0.7 + 0.4 * j)) + 0.01 * noise(state);
+    case SYNTH_CORI: {
+        // Quaternião girando em torno de Z
+        double half = 0.05 * t;
+        return j == 0 ? cos(half) : (j == 3 ? sin(half) : 0.0);
+    }
+    case SYNTH_GPS5:
+    case SYNTH_GPS9: {
+        // Trajeto retilíneo a ~10 m/s saindo de São Paulo
+        double meters = 10.0 * t;
+        switch (j) {
+        case 0: return -23.5505 + meters / 111320.0;
+        case 1: return -46.6333 + meters / 102000.0;
+        case 2: return 760.0 + 5.0 * sin(t * 0.01);
+        case 3:
+        case 4: return 10.0 + 0.2 * noise(state);
+        case 5: return 9000.0;             // Dias desde 2000
+        case 6: return 43200.0 + t;        // Segundos desde a meia-noite
+        case 7: return 1.2;                // DOP
+        default: return 3.0;               // Fix 3D
+        }
+    }
+    case SYNTH_SHUT: return 1.0 / (240.0 + 60.0 * sin(t * 0.02));
+    default: return 0.0;
+    }
+}
+
+// Sensor girado 30° em Z, gravado em MTRX: o sensor guarda Mᵀ·sinal e o parser devolve M·Mᵀ·sinal
+static const float imu_matrix[9] = { 0.8660254f, -0.5f, 0.0f, 0.5f, 0.8660254f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+// Sensor montado de lado, como nas HERO8+: o elemento j do sample é o eixo IMU_ORIN[j] do sinal
+#define IMU_ORIN "ZXY"
+#define IMU_ORIO "XYZ"
+
+// Valor que o sensor grava no elemento j; o parser desfaz MTRX ou ORIN/ORIO e devolve o sinal
+static double sensor_value(const SynthConfig* config, SynthKind kind, const double* physical, uint32_t j) {
+    if (kind != SYNTH_ACCL && kind != SYNTH_GYRO) return physical[j];
+    if (config->matrix) return imu_matrix[j] * physical[0] + imu_matrix[3 + j] * physical[1] + imu_matrix[6 + j] * physical[2];
+    if (config->orientation) return physical[IMU_ORIN[j] - 'X'];
+    return physical[j];
+}
+
+// Samples do payload p: [floor(p * n), floor((p + 1) * n)), n = rate * payload_seconds
+static uint32_t payload_samples(const SynthStream* stream, double payload_seconds, uint32_t p, uint64_t* first) {
+    double per_payload = stream->rate * payload_seconds;
+    uint64_t begin = (uint64_t)floor((double)p * per_payload);
+    uint64_t end = (uint64_t)floor((double)(p + 1) * per_payload);
+    *first = begin;
+    return (uint32_t)(end - begin);
+}
+
+static void put_stream(ByteBuffer* b, SynthStream* stream, const SynthConfig* config, uint32_t p, uint32_t* state) {
+    const SynthKindInfo* info = &kinds[stream->kind];
+    uint64_t first;
+    uint32_t samples = payload_samples(stream, config->payload_seconds, p, &first);
+    if (samples == 0 || samples > 0xFFFF) return;
+
+    stream->total += samples;
+    double start = (double)first / stream->rate;
+
+    size_t strm = begin_nest(b, "STRM");
+
+    put_klv_header(b, "STMP", 'J', 8, 1);
+    put_be64(b, (uint64_t)llround(start * 1000000.0));
+    put_klv_u32(b, "TSMP", (uint32_t)stream->total);
+    put_klv_string(b, "STNM", info->name);
+
+    if (info->units[0] != '\0') {
+        if (stream->kind == SYNTH_GPS5 || stream->kind == SYNTH_GPS9) {
+            // Uma unidade por elemento, 3 caracteres cada
+            put_klv_header(b, "UNIT", 'c', 3, (uint16_t)info->elements);
+            put_bytes(b, info->units, 3 * info->elements);
+            pad4(b);
+        } else {
+            put_klv_string(b, "SIUN", info->units);
+        }
+    }
+
+    // Temperatura do sensor: KLV fixo dentro dos STRM da IMU, como nas câmeras
+    if (stream->kind == SYNTH_ACCL || stream->kind == SYNTH_GYRO) {
+        float celsius = (float)(35.0 + 10.0 * (1.0 - exp(-start / 600.0)));
+        uint32_t bits;
+        memcpy(&bits, &celsius, sizeof(bits));
+        put_klv_header(b, "TMPC", 'f', 4, 1);
+        put_be32(b, bits);
+    }
+
+    if (info->type == 's') {
+        put_klv_header(b, "SCAL", 's', 2, 1);
+        put_be16(b, (uint16_t)info->scale[0]);
+        pad4(b);
+    } else if (info->type == 'l' || info->type == '?') {
+        put_klv_header(b, "SCAL", 'l', 4, (uint16_t)info->elements);
+        for (uint32_t j = 0; j < info->elements; j++) put_be32(b, (uint32_t)info->scale[j]);
+    }
+
+    if (stream->kind == SYNTH_ACCL || stream->kind == SYNTH_GYRO) {
+        if (config->matrix) {
+            put_klv_header(b, "MTRX", 'f', 4, 9);
+            for (int k = 0; k < 9; k++) {
+                uint32_t bits;
+                memcpy(&bits, &imu_matrix[k], sizeof(bits));
+                put_be32(b, bits);
+            }
+        } else if (config->orientation) {
+            put_klv_string(b, "ORIN", IMU_ORIN);
+            put_klv_string(b, "ORIO", IMU_ORIO);
+        }
+    }
+    if (info->type == '?') put_klv_string(b, "TYPE", info->complex);
+
+    if (info->type == 's') {
+        int16_t* values = malloc((size_t)samples * info->elements * sizeof(int16_t));
+        if (!values) exit(1);
+        for (uint32_t s = 0; s < samples; s++) {
+            double t = (double)(first + s) / stream->rate;
+            double physical[4];
+            for (uint32_t j = 0; j < info->elements; j++) physical[j] = signal_value(stream->kind, j, t, state);
+            for (uint32_t j = 0; j < info->elements; j++) {
+                double v = sensor_value(config, stream->kind, physical, j) * info->scale[0];
+                if (v > 32767.0) v = 32767.0;
+                if (v < -32768.0) v = -32768.0;
+                values[s * info->elements + j] = (int16_t)lround(v);
+            }
+        }
+
+        if (!config->compress || !put_compressed_shorts(b, info->key, values, samples, info->elements)) {
+            put_klv_header(b, info->key, 's', (uint8_t)(info->elements * 2), (uint16_t)samples);
+            for (uint32_t k = 0; k < samples * info->elements; k++) put_be16(b, (uint16_t)values[k]);
+            pad4(b);
+        }
+        free(values);
+    } else if (info->type == 'l') {
+        put_klv_header(b, info->key, 'l', (uint8_t)(info->elements * 4), (uint16_t)samples);
+        for (uint32_t s = 0; s < samples; s++) {
+            double t = (double)(first + s) / stream->rate;
+            for (uint32_t j = 0; j < info->elements; j++) {
+                put_be32(b, (uint32_t)(int32_t)llround(signal_value(stream->kind, j, t, state) * info->scale[j]));
+            }
+        }
+    } else if (info->type == '?') {
+        uint32_t struct_size = 0;
+        for (uint32_t j = 0; j < info->elements; j++) struct_size += info->complex[j] == 'l' ? 4 : 2;
+        put_klv_header(b, info->key, '?', (uint8_t)struct_size, (uint16_t)samples);
+        for (uint32_t s = 0; s < samples; s++) {
+            double t = (double)(first + s) / stream->rate;
+            for (uint32_t j = 0; j < info->elements; j++) {
+                int64_t v = llround(signal_value(stream->kind, j, t, state) * info->scale[j]);
+                if (info->complex[j] == 'l') put_be32(b, (uint32_t)(int32_t)v);
+                else put_be16(b, (uint16_t)v);
+            }
+        }
+        pad4(b);
+    } else {
+        put_klv_header(b, info->key, 'f', (uint8_t)(info->elements * 4), (uint16_t)samples);
+        for (uint32_t s = 0; s < samples; s++) {
+            double t = (double)(first + s) / stream->rate;
+            for (uint32_t j = 0; j < info->elements; j++) {
+                float f = (float)signal_value(stream->kind, j, t, state);
+                uint32_t bits;
+                memcpy(&bits, &f, sizeof(bits));
+                put_be32(b, bits);
+            }
+        }
+    }
+
+    end_nest(b, strm);
+}
+
+static void build_payload(ByteBuffer* b, SynthConfig* config, uint32_t p, uint32_t* state) {
+    b->size = 0;
+    size_t devc = begin_nest(b, "DEVC");
+    put_klv_u32(b, "DVID", 1);
+    put_klv_string(b, "DVNM", "HERO Synthetic");
+    for (int i = 0; i < config->stream_count; i++) put_stream(b, &config->streams[i], config, p, state);
+    end_nest(b, devc);
+}
+
+// MARK: - MP4
+
+static size_t begin_atom(ByteBuffer* b, const char* type) {
+    size_t header = b->size;
+    put_be32(b, 0);
+    put_bytes(b, type, 4);
+    return header;
+}
+
+static void end_atom(ByteBuffer* b, size_t header) {
+    patch_be32(b, header, (uint32_t)(b->size - header));
+}
+
+static void put_zeros(ByteBuffer* b, size_t count) {
+    while (count--) put_u8(b, 0);
+}
+
+// moov com uma única trak de metadados ('meta'/'gpmd'), um payload por chunk
+static void build_moov(ByteBuffer* b, const uint32_t* sizes, const uint64_t* offsets, uint32_t count,
+                       uint32_t payload_ticks, int use_co64) {
+    uint32_t duration = count * payload_ticks;
+    static const uint32_t identity[9] = { 0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000 };
+
+    size_t moov = begin_atom(b, "moov");
+
+    size_t mvhd = begin_atom(b, "mvhd");
+    put_be32(b, 0);                  // versão/flags
+    put_be32(b, 0);                  // criação
+    put_be32(b, 0);                  // modificação
+    put_be32(b, META_TIMESCALE);
+    put_be32(b, duration);
+    put_be32(b, 0x10000);            // taxa 1.0
+    put_be16(b, 0x100);              // volume 1.0
+    put_zeros(b, 10);
+    for (int i = 0; i < 9; i++) put_be32(b, identity[i]);
+    put_zeros(b, 24);
+    put_be32(b, 2);                  // próximo track ID
+    end_atom(b, mvhd);
+
+    size_t trak = begin_atom(b, "trak");
+
+    size_t tkhd = begin_atom(b, "tkhd");
+    put_be32(b, 0x7);                // habilitado, no filme, no preview
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, 1);                  // track ID
+    put_be32(b, 0);
+    put_be32(b, duration);
+    put_zeros(b, 8);
+    put_be16(b, 0);                  // camada
+    put_be16(b, 0);                  // grupo
+    put_be16(b, 0);                  // volume
+    put_be16(b, 0);
+    for (int i = 0; i < 9; i++) put_be32(b, identity[i]);
+    put_be32(b, 0);                  // largura
+    put_be32(b, 0);                  // altura
+    end_atom(b, tkhd);
+
+    size_t mdia = begin_atom(b, "mdia");
+
+    size_t mdhd = begin_atom(b, "mdhd");
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, 0);
+    put_be32(b, META_TIMESCALE);
+    put_be32(b, duration);
+    put_be16(b, 0x55C4);             // idioma "und"
+    put_be16(b, 0);
+    end_atom(b, mdhd);
+
+    size_t hdlr = begin_atom(b, "hdlr");
+    put_be32(b, 0);
+    put_bytes(b, "mhlr", 4);
+    put_bytes(b, "meta", 4);
+    put_zeros(b, 12);
+    put_bytes(b, "GoPro MET", 10);   // Nome com o terminador
+    end_atom(b, hdlr);
+
+    size_t minf = begin_atom(b, "minf");
+    size_t stbl = begin_atom(b, "stbl");
+
+    size_t stsd = begin_atom(b, "stsd");
+    put_be32(b, 0);
+    put_be32(b, 1);                  // uma descrição
+    put_be32(b, 16);                 // tamanho da entrada
+    put_bytes(b, "gpmd", 4);
+    put_zeros(b, 6);
+    put_be16(b, 1);                  // data reference index
+    end_atom(b, stsd);
+
+    size_t stts = begin_atom(b, "stts");
+    put_be32(b, 0);
+    put_be32(b, 1);
+    put_be32(b, count);
+    put_be32(b, payload_ticks);
+    end_atom(b, stts);
+
+    size_t stsc = begin_atom(b, "stsc");
+    put_be32(b, 0);
+    put_be32(b, 1);
+    put_be32(b, 1);                  // primeiro chunk
+    put_be32(b, 1);                  // samples por chunk
+    put_be32(b, 1);                  // descrição
+    end_atom(b, stsc);
+
+    size_t stsz = begin_atom(b, "stsz");
+    put_be32(b, 0);
+    put_be32(b, 0);                  // tamanhos variados
+    put_be32(b, count);
+    for (uint32_t i = 0; i < count; i++) put_be32(b, sizes[i]);
+    end_atom(b, stsz);
+
+    size_t stco = begin_atom(b, use_co64 ? "co64" : "stco");
+    put_be32(b, 0);
+    put_be32(b, count);
+    for (uint32_t i = 0; i < count; i++) {
+        if (use_co64) put_be64(b, offsets[i]);
+        else put_be32(b, (uint32_t)offsets[i]);
+    }
+    end_atom(b, stco);
+
+    end_atom(b, stbl);
+    end_atom(b, minf);
+    end_atom(b, mdia);
+    end_atom(b, trak);
+    end_atom(b, moov);
+}
+
+// MARK: - CLI
+
+static int add_stream(SynthConfig* config, const char* key, double rate) {
+    for (int k = 0; k < SYNTH_KIND_COUNT; k++) {
+        if (strncmp(kinds[k].key, key, 4) != 0) continue;
+
+        for (int i = 0; i < config->stream_count; i++) {
+            if (config->streams[i].kind == (SynthKind)k) {
+                if (rate > 0.0) config->streams[i].rate = rate;
+                return 1;
+            }
+        }
+        if (config->stream_count >= MAX_SYNTH_STREAMS) return 0;
+
+        SynthStream* stream = &config->streams[config->stream_count++];
+        memset(stream, 0, sizeof(SynthStream));
+        stream->kind = (SynthKind)k;
+        stream->rate = rate > 0.0 ? rate : kinds[k].default_rate;
+        return 1;
+    }
+    fprintf(stderr, "gpmf-synth: stream desconhecido '%.4s' (use ACCL, GYRO, CORI, GPS5, GPS9, SHUT)\n", key);
+    return 0;
+}
+
+// "ACCL,GYRO@400,GPS5": taxa opcional depois de '@'
+static int parse_stream_list(SynthConfig* config, const char* list) {
+    const char* p = list;
+    while (*p) {
+        while (*p == ',') p++;
+        if (!*p) break;
+
+        char key[5] = { 0 };
+        int len = 0;
+        while (*p && *p != ',' && *p != '@') {
+            if (len < 4) key[len] = *p;
+            len++;
+            p++;
+        }
+        double rate = 0.0;
+        if (*p == '@') rate = strtod(p + 1, (char**)&p);
+        if (len != 4 || !add_stream(config, key, rate)) return 0;
+    }
+    return config->stream_count > 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "uso: gpmf-synth [-d segundos] [-p segundos] [-s streams] [-c] [-o] [-m] [-r semente] saida.mp4\n"
+            "  -d  duração da gravação (padrão 60; ex: 36000 = 10 horas)\n"
+            "  -p  duração de cada payload (padrão 1.001)\n"
+            "  -s  streams e taxas, ex: ACCL,GYRO@400,GPS5@10,GPS9,CORI,SHUT (padrão ACCL,GYRO,GPS5)\n"
+            "  -c  comprime os streams de 16 bits (ACCL, GYRO, CORI) em '#'\n"
+            "  -o  grava ACCL/GYRO na ordem do sensor com ORIN/ORIO (ZXY -> XYZ)\n"
+            "  -m  grava ACCL/GYRO girados com uma MTRX de calibração (tem precedência sobre -o)\n"
+            "  -r  semente do ruído (padrão 1)\n");
+}
+
+int main(int argc, char** argv) {
+    SynthConfig config;
+    memset(&config, 0, sizeof(config));
+    config.duration = 60.0;
+    config.payload_seconds = 1.001;
+    config.seed = 1;
+
+    const char* output = NULL;
+    const char* stream_list = "ACCL,GYRO,GPS5";
+
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "-c") == 0) {
+            config.compress = 1;
+        } else if (strcmp(arg, "-o") == 0) {
+            config.orientation = 1;
+        } else if (strcmp(arg, "-m") == 0) {
+            config.matrix = 1;
+        } else if (arg[0] == '-' && arg[1] != '\0' && arg[2] == '\0' && i + 1 < argc) {
+            const char* value = argv[++i];
+            switch (arg[1]) {
+            case 'd': config.duration = atof(value); break;
+            case 'p': config.payload_seconds = atof(value); break;
+            case 's': stream_list = value; break;
+            case 'r': config.seed = (uint32_t)strtoul(value, NULL, 10); break;
+            default: usage(); return 2;
+            }
+        } else if (arg[0] != '-' && !output) {
+            output = arg;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    if (!output || !(config.duration > 0.0) || !(config.payload_seconds >= 0.001) || !parse_stream_list(&config, stream_list)) {
+        usage();
+        return 2;
+    }
+
+    uint32_t payload_ticks = (uint32_t)llround(config.payload_seconds * META_TIMESCALE);
+    double payload_count_real = ceil(config.duration * META_TIMESCALE / payload_ticks);
+    if (payload_count_real * payload_ticks > 4294967295.0 || payload_count_real >= 5184000.0) {
+        fprintf(stderr, "gpmf-synth: duração longa demais para o índice MP4\n");
+        return 2;
+    }
+    uint32_t payload_count = (uint32_t)payload_count_real;
+    config.payload_seconds = (double)payload_ticks / META_TIMESCALE; // Mesmo tempo que o MP4 anuncia
+
+    FILE* file = fopen(output, "wb");
+    if (!file) {
+        fprintf(stderr, "gpmf-synth: não foi possível criar %s\n", output);
+        return 1;
+    }
+
+    uint32_t* sizes = malloc((size_t)payload_count * sizeof(uint32_t));
+    uint64_t* offsets = malloc((size_t)payload_count * sizeof(uint64_t));
+    if (!sizes || !offsets) {
+        fprintf(stderr, "gpmf-synth: sem memória\n");
+        return 1;
+    }
+
+    // ftyp + cabeçalho de mdat em 64 bits (o tamanho é corrigido no final)
+    ByteBuffer header = { 0 };
+    size_t ftyp = begin_atom(&header, "ftyp");
+    put_bytes(&header, "mp41", 4);
+    put_be32(&header, 0x20130227);
+    put_bytes(&header, "mp41isom", 8);
+    end_atom(&header, ftyp);
+    put_be32(&header, 1);
+    put_bytes(&header, "mdat", 4);
+    put_be64(&header, 0);
+    fwrite(header.data, 1, header.size, file);
+
+    uint64_t mdat_start = header.size - 16;
+    uint64_t position = header.size;
+    uint32_t state = config.seed ? config.seed : 1;
+    ByteBuffer payload = { 0 };
+
+    for (uint32_t p = 0; p < payload_count; p++) {
+        build_payload(&payload, &config, p, &state);
+        if (fwrite(payload.data, 1, payload.size, file) != payload.size) {
+            fprintf(stderr, "gpmf-synth: falha ao gravar %s\n", output);
+            return 1;
+        }
+        sizes[p] = (uint32_t)payload.size;
+        offsets[p] = position;
+        position += payload.size;
+    }
+
+    // Tamanho real do mdat
+    uint64_t mdat_size = position - mdat_start;
+    ByteBuffer patch = { 0 };
+    put_be64(&patch, mdat_size);
+    fseek(file, (long)(mdat_start + 8), SEEK_SET);
+    fwrite(patch.data, 1, patch.size, file);
+    fseek(file, 0, SEEK_END);
+
+    ByteBuffer moov = { 0 };
+    build_moov(&moov, sizes, offsets, payload_count, payload_ticks, position > 0xFFFFFFFFull);
+    fwrite(moov.data, 1, moov.size, file);
+    fclose(file);
+
+    printf("gpmf-synth: %s, %u payloads, %.1f MB de GPMF\n", output, payload_count, (double)(position - header.size) / (1024.0 * 1024.0));
+    for (int i = 0; i < config.stream_count; i++) {
+        printf("  %s @ %.3f Hz: %llu samples%s\n", kinds[config.streams[i].kind].key, config.streams[i].rate,
+               (unsigned long long)config.streams[i].total,
+               config.compress && kinds[config.streams[i].kind].type == 's' ? " (comprimido)" : "");
+    }
+
+    free(sizes);
+    free(offsets);
+    free(header.data);
+    free(payload.data);
+    free(patch.data);
+    free(moov.data);
+    return 0;
+}